@@ -0,0 +1,123 @@
+#include <QCryptographicHash>
+#include <QDesktopServices>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QTimer>
+#include <QtConcurrentRun>
+
+#include "document.h"
+
+#include "autosaver.h"
+
+Autosaver::Autosaver(QObject *parent)
+    : QObject(parent), document_(NULL), snapshotRevision_(-1),
+      writingRevision_(-1), savedRevision_(-1)
+{
+  timer_ = new QTimer(this);
+  timer_->setInterval(AUTOSAVE_INTERVAL);
+
+  connect(timer_, SIGNAL(timeout()), this, SLOT(autosave()));
+  connect(&watcher_, SIGNAL(finished()), this, SLOT(written()));
+}
+
+Autosaver::~Autosaver()
+{
+  watcher_.waitForFinished();
+}
+
+void Autosaver::setDocument(Document *doc)
+{
+  /* a write in flight belongs to the previous document */
+  watcher_.waitForFinished();
+
+  document_ = doc;
+  snapshot_ = DocumentSnapshot();
+  snapshotRevision_ = -1;
+  writingRevision_ = -1;
+  savedRevision_ = -1;
+  path_ = QString();
+
+  if (document_)
+    timer_->start();
+  else
+    timer_->stop();
+}
+
+void Autosaver::discard()
+{
+  watcher_.waitForFinished();
+
+  if (!path_.isEmpty())
+    QFile::remove(path_);
+  if (document_)
+    QFile::remove(recoveryPath(document_->name()));
+
+  snapshot_ = DocumentSnapshot();
+  snapshotRevision_ = -1;
+  savedRevision_ = -1;
+  path_ = QString();
+}
+
+QString Autosaver::recoveryPath(const QString &name)
+{
+  QString dir = QDesktopServices::storageLocation(
+      QDesktopServices::DataLocation);
+  if (dir.isEmpty())
+    dir = QDir::tempPath();
+
+  QString file = "untitled.stitchy";
+  if (!name.isEmpty()) {
+    QByteArray key = QCryptographicHash::hash(
+        QFileInfo(name).absoluteFilePath().toUtf8(),
+        QCryptographicHash::Md5).toHex();
+    file = QString("%1.stitchy").arg(QString::fromLatin1(key));
+  }
+
+  return QDir(QDir(dir).filePath("recovery")).filePath(file);
+}
+
+void Autosaver::autosave()
+{
+  if (!document_ || !document_->changed() || watcher_.isRunning())
+    return;
+
+  /* a document still loading has nothing new to recover yet */
+  if (!document_->isLoaded())
+    return;
+
+  int revision = document_->revision();
+  if (revision == savedRevision_)
+    return;
+
+  if (revision != snapshotRevision_) {
+    snapshot_ = DocumentIoV2::snapshot(document_);
+    snapshotRevision_ = revision;
+  }
+
+  /* the name may have changed with save as */
+  QString path = recoveryPath(document_->name());
+  if (path != path_ && !path_.isEmpty())
+    QFile::remove(path_);
+  path_ = path;
+
+  writingRevision_ = revision;
+  watcher_.setFuture(QtConcurrent::run(&Autosaver::write, snapshot_, path_));
+}
+
+void Autosaver::written()
+{
+  if (watcher_.result())
+    savedRevision_ = writingRevision_;
+  else
+    qWarning("Could not autosave to %s", qPrintable(path_));
+}
+
+bool Autosaver::write(DocumentSnapshot snapshot, QString path)
+{
+  if (!QDir().mkpath(QFileInfo(path).absolutePath()))
+    return false;
+
+  QString error;
+  return DocumentFactory::save(snapshot, path, error);
+}
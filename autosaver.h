@@ -0,0 +1,64 @@
+#ifndef _AUTOSAVER_H_
+#define _AUTOSAVER_H_
+
+#include <QFutureWatcher>
+#include <QObject>
+#include <QString>
+
+#include "documentio.h"
+
+class QTimer;
+
+class Document;
+
+/* milliseconds between autosaves */
+#define AUTOSAVE_INTERVAL (2 * 60 * 1000)
+
+/* Periodic recovery copies of the active document.
+ *
+ * Every AUTOSAVE_INTERVAL, a document with unsaved changes is copied into
+ * a DocumentSnapshot on the GUI thread, which is a single walk over the
+ * map, and the snapshot is encoded and written on the thread pool. The
+ * recovery file is written aside and renamed over the previous one. A
+ * snapshot is kept along with the revision it was taken at, so a write
+ * that failed is retried without walking the document again, and nothing
+ * happens at all while the document is unchanged. */
+class Autosaver : public QObject
+{
+  Q_OBJECT;
+
+ public:
+  Autosaver(QObject *parent = NULL);
+  ~Autosaver();
+
+  /* the document to watch, NULL for none */
+  void setDocument(Document *doc);
+
+  /* removes the recovery file, once the document was saved or closed
+   * without saving */
+  void discard();
+
+  /* recovery file of a document, by its file name; untitled documents
+   * share "untitled.stitchy" */
+  static QString recoveryPath(const QString &name);
+
+ private slots:
+  void autosave();
+  void written();
+
+ private:
+  static bool write(DocumentSnapshot snapshot, QString path);
+
+ private:
+  Document *document_;
+  QTimer *timer_;
+  QFutureWatcher<bool> watcher_;
+
+  DocumentSnapshot snapshot_;
+  int snapshotRevision_;
+  int writingRevision_;
+  int savedRevision_;
+  QString path_;
+};
+
+#endif
@@ -0,0 +1,204 @@
+#include <stdio.h>
+
+#include <QDir>
+#include <QFileInfo>
+#include <QtConcurrentMap>
+
+#include "colormanager.h"
+#include "documentio.h"
+#include "globalstate.h"
+
+#include "batchconverter.h"
+
+struct BatchJob
+{
+  ImageImporter *importer;
+  QString input;
+  QString output;
+  bool ok;
+  QString error;
+};
+
+BatchConverter::BatchConverter()
+    : width_(0), manager_(NULL), ditherMode_(DitherMode_None), maxColors_(0),
+      hasTransparent_(false)
+{
+
+}
+
+BatchConverter::~BatchConverter()
+{
+
+}
+
+bool BatchConverter::parseArguments(const QStringList &args, QString &error)
+{
+  QString palette;
+
+  int i = args.indexOf("--batch");
+  if (i < 0 || i + 1 >= args.size()) {
+    error = QObject::tr("No input folder given.");
+    return false;
+  }
+  input_ = args[++i];
+
+  for (++i; i < args.size(); ++i) {
+    const QString &arg = args[i];
+
+    if (i + 1 >= args.size()) {
+      error = QObject::tr("Missing value for %1.").arg(arg);
+      return false;
+    }
+    const QString &value = args[++i];
+
+    if (arg == "--width") {
+      width_ = value.toInt();
+    } else if (arg == "--palette") {
+      palette = value;
+    } else if (arg == "--output") {
+      output_ = value;
+    } else if (arg == "--colors") {
+      maxColors_ = value.toInt();
+    } else if (arg == "--transparent") {
+      transparentColor_ = QColor(value);
+      hasTransparent_ = transparentColor_.isValid();
+      if (!hasTransparent_) {
+        error = QObject::tr("Invalid color %1.").arg(value);
+        return false;
+      }
+    } else if (arg == "--dither") {
+      if (value == "none")
+        ditherMode_ = DitherMode_None;
+      else if (value == "floyd-steinberg")
+        ditherMode_ = DitherMode_FloydSteinberg;
+      else if (value == "atkinson")
+        ditherMode_ = DitherMode_Atkinson;
+      else if (value == "jarvis")
+        ditherMode_ = DitherMode_Jarvis;
+      else if (value == "ordered")
+        ditherMode_ = DitherMode_Ordered;
+      else {
+        error = QObject::tr("Unknown dithering %1.").arg(value);
+        return false;
+      }
+    } else {
+      error = QObject::tr("Unknown option %1.").arg(arg);
+      return false;
+    }
+  }
+
+  if (width_ <= 0) {
+    error = QObject::tr("A positive --width is required.");
+    return false;
+  }
+
+  if (!QFileInfo(input_).isDir()) {
+    error = QObject::tr("%1 is not a folder.").arg(input_);
+    return false;
+  }
+
+  if (output_.isEmpty())
+    output_ = input_;
+
+  MetaColorManager *mcm = GlobalState::self()->colorManager();
+  manager_ = mcm->colorManager(palette);
+  if (!manager_) {
+    error = QObject::tr("Unknown palette %1.").arg(palette);
+    return false;
+  }
+
+  return true;
+}
+
+QString BatchConverter::usage()
+{
+  return QObject::tr(
+      "Usage: stitchy --batch FOLDER --width CELLS --palette ID [options]\n"
+      "\n"
+      "Converts every image in FOLDER into a .stitchy chart.\n"
+      "\n"
+      "  --output FOLDER      where to write the charts (default: FOLDER)\n"
+      "  --colors N           use at most N colors\n"
+      "  --dither MODE        none, floyd-steinberg, atkinson, jarvis, ordered\n"
+      "  --transparent COLOR  leave pixels of this color empty\n");
+}
+
+int BatchConverter::run()
+{
+  QList<BatchJob> jobs;
+  QSet<QString> taken;
+
+  foreach (const QString &input, inputFiles()) {
+    BatchJob job;
+    job.importer = NULL;
+    job.input = input;
+    job.output = outputPath(input, taken);
+    job.ok = false;
+    jobs.append(job);
+  }
+
+  /* lookup caches are built here, the workers only share them */
+  for (int i = 0; i < jobs.size(); ++i) {
+    jobs[i].importer = new ImageImporter(
+        manager_, width_, hasTransparent_ ? &transparentColor_ : NULL);
+    jobs[i].importer->setDitherMode(ditherMode_);
+    jobs[i].importer->setMaxColors(maxColors_);
+  }
+
+  QtConcurrent::blockingMap(jobs, &BatchConverter::convert);
+
+  int failed = 0;
+  foreach (const BatchJob &job, jobs) {
+    if (job.ok) {
+      fprintf(stdout, "%s -> %s\n", qPrintable(job.input),
+              qPrintable(job.output));
+    } else {
+      fprintf(stderr, "%s: %s\n", qPrintable(job.input),
+              qPrintable(job.error));
+      ++failed;
+    }
+  }
+
+  return failed;
+}
+
+QStringList BatchConverter::inputFiles() const
+{
+  QStringList filters;
+  filters << "*.png" << "*.jpg" << "*.jpeg" << "*.bmp";
+
+  QDir dir(input_);
+  QStringList files;
+  foreach (const QString &name, dir.entryList(filters, QDir::Files, QDir::Name))
+    files.append(dir.filePath(name));
+
+  return files;
+}
+
+QString BatchConverter::outputPath(const QString &input,
+                                   QSet<QString> &taken) const
+{
+  /* images sharing a base name, like a.png and a.jpg, would otherwise be
+   * written to the same chart at once; later ones get a number */
+  QString base = QFileInfo(input).completeBaseName();
+  QString name = base + ".stitchy";
+  for (int n = 2; taken.contains(name.toLower()); ++n)
+    name = QString("%1-%2.stitchy").arg(base).arg(n);
+
+  taken.insert(name.toLower());
+  return QDir(output_).filePath(name);
+}
+
+void BatchConverter::convert(BatchJob &job)
+{
+  /* the importer holds the decoded image only while it runs */
+  if (!job.importer->run(job.input))
+    job.error = QObject::tr("Error loading image file.");
+  else
+    job.ok = DocumentFactory::save(*job.importer,
+                                   QFileInfo(job.input).completeBaseName(),
+                                   job.output, job.error);
+
+  delete job.importer;
+  job.importer = NULL;
+}
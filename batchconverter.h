@@ -0,0 +1,52 @@
+#ifndef _BATCHCONVERTER_H_
+#define _BATCHCONVERTER_H_
+
+#include <QColor>
+#include <QList>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+
+#include "imageimporter.h"
+
+class ColorManager;
+
+struct BatchJob;
+
+/* Headless image import.
+ *
+ * Converts every image in a folder into a .stitchy chart with the given
+ * width and color set. Images are converted concurrently on the global
+ * thread pool; each one goes straight from the importer's cell grid to
+ * the file, so no document, scene or widget is ever created. */
+class BatchConverter
+{
+ public:
+  BatchConverter();
+  ~BatchConverter();
+
+  /* reads the options following --batch, returns false on bad usage */
+  bool parseArguments(const QStringList &args, QString &error);
+  static QString usage();
+
+  /* returns the number of images that failed */
+  int run();
+
+ private:
+  QStringList inputFiles() const;
+  QString outputPath(const QString &input, QSet<QString> &taken) const;
+
+  static void convert(BatchJob &job);
+
+ private:
+  QString input_;
+  QString output_;
+  int width_;
+  ColorManager *manager_;
+  DitherMode ditherMode_;
+  int maxColors_;
+  bool hasTransparent_;
+  QColor transparentColor_;
+};
+
+#endif
@@ -1,12 +1,14 @@
 #include <QApplication>
 #include <QClipboard>
 #include <QMouseEvent>
+#include <QResizeEvent>
 #include <QWheelEvent>
 
 #include "cell.h"
 #include "document.h"
 #include "editor.h"
 #include "editoractions.h"
+#include "floodfill.h"
 #include "globalstate.h"
 #include "selection.h"
 #include "selectiongroup.h"
@@ -103,21 +105,26 @@ void Canvas::setDocument(Document *doc)
     setScene(doc);
   else
     setScene(NULL);
+
+  updateVisibleRegion();
 }
 
 void Canvas::zoomIn()
 {
   scale(1.0 + MAGNIFICATION_RATE, 1.0 + MAGNIFICATION_RATE);
+  updateVisibleRegion();
 }
 
 void Canvas::zoomOut()
 {
   scale(1.0 - MAGNIFICATION_RATE, 1.0 - MAGNIFICATION_RATE);
+  updateVisibleRegion();
 }
 
 void Canvas::zoomReset()
 {
   resetMatrix();
+  updateVisibleRegion();
 }
 
 void Canvas::toggleGrid(bool enabled)
@@ -146,11 +153,10 @@ void Canvas::copy()
   if (!d->selection())
     return;
 
+  d->ensureLoaded(d->selection()->rect());
   SelectionGroup *grp = new SelectionGroup(d, d->selection()->rect(), false);
   QClipboard *clipboard = QApplication::clipboard();
-  QMimeData *mimeData = new QMimeData();
-  mimeData->setData(SelectionGroup::mimeType(), grp->serialize());
-  clipboard->setMimeData(mimeData);
+  clipboard->setMimeData(new SelectionMimeData(grp->serialize()));
   
   delete grp;
 }
@@ -165,10 +171,10 @@ void Canvas::paste()
   const QMimeData *data = clipboard->mimeData();
   if (!data)
     return;
-  if (!data->hasFormat(SelectionGroup::mimeType()))
+  if (!SelectionGroup::canDecode(data))
     return;
 
-  paste(data->data(SelectionGroup::mimeType()), true);
+  paste(SelectionGroup::fromMimeData(data), true);
 }
 
 void Canvas::paste(const QByteArray &data, bool action)
@@ -196,6 +202,7 @@ void Canvas::deleteSelected()
   
   Selection *selection = d->selection();
   const QRect &rect = selection->rect();
+  d->ensureLoaded(rect);
 
   SparseMap *orig = d->map();
   SparseMap *map = new SparseMap(d);
@@ -259,6 +266,7 @@ void Canvas::commitPaste()
   if (!doc || !doc->floatingSelection())
     return;
 
+  doc->ensureLoaded(doc->floatingSelection()->region());
   doc->editor()->edit(new ActionFloatCommit(doc, this, doc->floatingSelection()));
 }
 
@@ -308,6 +316,24 @@ void Canvas::setCenter(const QPointF& centerPoint)
   centerOn(center_);
 }
 
+void Canvas::fill(const QPoint &pos)
+{
+  Document *doc = GlobalState::self()->activeDocument();
+  const Color *c = GlobalState::self()->color();
+
+  Selection *sel = doc->selection();
+  if (sel && !sel->within(pos))
+    return;
+
+  doc->ensureLoaded(sel ? sel->rect() : QRect());
+  FloodFill ff(doc, sel ? sel->rect() : doc->boundingRect());
+  if (!ff.run(pos, GlobalState::self()->fillDiagonal()) ||
+      ff.regionColor() == c)
+    return;
+
+  doc->editor()->edit(new ActionFill(doc, ff.positions(), ff.regionColor(), c));
+}
+
 void Canvas::mousePressEvent(QMouseEvent *event)
 {
   Document *doc = GlobalState::self()->activeDocument();
@@ -351,8 +377,10 @@ void Canvas::mousePressEvent(QMouseEvent *event)
 
       moving_ = true;
 
-      if (!doc->floatingSelection() && !floatingSelection_)
+      if (!doc->floatingSelection() && !floatingSelection_) {
+        doc->ensureLoaded(sel->rect());
         floatingSelection_ = new SelectionGroup(doc, sel->rect(), true);
+      }
 
       startPos_ = sel->rect().topLeft();
       lastPos_ = cursor;
@@ -363,6 +391,13 @@ void Canvas::mousePressEvent(QMouseEvent *event)
     if (!GlobalState::self()->color() || !doc)
       return;
 
+    if (mode == ToolMode_Fill) {
+      QPoint cursor;
+      if (mapToGrid(event->pos(), cursor))
+        fill(cursor);
+      return;
+    }
+
     drawmap_ = new SparseMap(doc);
 
     Selection *sel = doc->selection();
@@ -441,6 +476,7 @@ void Canvas::mouseMoveEvent(QMouseEvent *event)
     if (cursor != cursor_) {
       /* draw */
 
+      doc->ensureLoaded(QRect(cursor, QSize(1, 1)));
       Cell *cell = drawmap_->cellAt(cursor);
       if (!cell)
         return;
@@ -483,6 +519,7 @@ void Canvas::mouseMoveEvent(QMouseEvent *event)
     if (cursor != cursor_) {
       cursor_ = cursor;
 
+      doc->ensureLoaded(QRect(cursor, QSize(1, 1)));
       SparseMap *map = doc->map();
       
       if (map->contains(cursor)) {
@@ -508,6 +545,8 @@ void Canvas::mouseMoveEvent(QMouseEvent *event)
     if (!rect.isValid())
         rect = rect.normalized();
 
+    doc->ensureLoaded(rect);
+
     for (int y = rect.y(); y < rect.y() + rect.height(); ++y) {
       for (int x = rect.x(); x < rect.x() + rect.width(); ++x) {
         if (!drawmap_->contains(QPoint(x, y))) {
@@ -618,6 +657,7 @@ void Canvas::mouseReleaseEvent(QMouseEvent *event)
       Selection *sel = doc->selection();
       moving_ = false;
       if (floatingSelection_) {
+        doc->ensureLoaded(sel->rect());
 	doc->editor()->edit(new ActionMove(doc, startPos_, sel->rect().size(),
 					   floatingSelection_));
 	delete floatingSelection_;
@@ -642,4 +682,28 @@ void Canvas::wheelEvent(QWheelEvent *event)
   }
 
   scale(mag, mag);
+  updateVisibleRegion();
+}
+
+void Canvas::updateVisibleRegion()
+{
+  Document *doc = static_cast<Document *>(scene());
+  if (!doc)
+    return;
+
+  QRectF area = mapToScene(viewport()->rect()).boundingRect();
+  doc->setVisibleRegion(QRect(QPoint(area.left() / 10, area.top() / 10),
+                              QPoint(area.right() / 10, area.bottom() / 10)));
+}
+
+void Canvas::scrollContentsBy(int dx, int dy)
+{
+  QGraphicsView::scrollContentsBy(dx, dy);
+  updateVisibleRegion();
+}
+
+void Canvas::resizeEvent(QResizeEvent *event)
+{
+  QGraphicsView::resizeEvent(event);
+  updateVisibleRegion();
 }
@@ -6,6 +6,7 @@
 #include "cell.h"
 
 class QMouseEvent;
+class QResizeEvent;
 class QWheelEvent;
 
 class SelectionGroup;
@@ -44,6 +45,11 @@ class Canvas : public QGraphicsView
 
  private:
   void setCenter(const QPointF &centerPoint);
+  void fill(const QPoint &pos);
+  void updateVisibleRegion();
+
+  void scrollContentsBy(int dx, int dy);
+  void resizeEvent(QResizeEvent *event);
 
   void mousePressEvent(QMouseEvent *event);
   void mouseMoveEvent(QMouseEvent *event);
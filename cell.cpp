@@ -1,6 +1,7 @@
 #include <QGraphicsItem>
 #include <QGraphicsScene>
 
+#include "colormanager.h"
 #include "document.h"
 #include "stitch.h"
 #include "utils.h"
@@ -30,8 +31,20 @@ bool FeatureMaskTest(int mask, int feature)
   return mask & featureMaskList[feature];
 }
 
+StitchType FeatureStitchType(int feature)
+{
+  if (feature == CELL_FULL)
+    return StitchType_Full;
+  else if (feature <= CELL_HALF_BS)
+    return StitchType_Half;
+  else if (feature <= CELL_PETITE_BR)
+    return StitchType_Petite;
+
+  return StitchType_Quarter;
+}
+
 Cell::Cell()
-    : document_(NULL)
+    : document_(NULL), tracker_(NULL)
 {
   featureMask_ = 0;
   for (int i = 0; i < CELL_COUNT; ++i) {
@@ -41,7 +54,7 @@ Cell::Cell()
 }
 
 Cell::Cell(const QPoint &pos, Document *document)
-    : pos_(pos), document_(document)
+    : pos_(pos), document_(document), tracker_(NULL)
 {
   featureMask_ = 0;
   for (int i = 0; i < CELL_COUNT; ++i) {
@@ -55,6 +68,7 @@ Cell::Cell(const Cell &other)
   featureMask_ = other.featureMask_;
   pos_ = other.pos_;
   document_ = other.document_;
+  tracker_ = NULL;
   for (int i = 0; i < CELL_COUNT; ++i) {
     features_[i] = NULL;
     colors_[i] = other.colors_[i];
@@ -181,11 +195,13 @@ void Cell::remove(int feature)
     return;
 
   if (features_[feature]) {
-    StitchItem *it = features_[feature];
-    it->release();
-    delete it;
+    delete features_[feature];
     features_[feature] = NULL;
   }
+  if (tracker_) {
+    tracker_->release(colors_[feature], FeatureStitchType(feature));
+    tracker_->touch(pos_);
+  }
   colors_[feature] = NULL;
 
   featureMask_ = featureMask_ & ~featureMaskList[feature];
@@ -195,7 +211,6 @@ void Cell::createGraphicsItems(QGraphicsItem *parent)
 {
   for (int i = 0; i < CELL_COUNT; ++i) {
     if (features_[i]) {
-      features_[i]->release();
       delete features_[i];
       features_[i] = NULL;
     }
@@ -256,7 +271,6 @@ void Cell::createGraphicsItems(QGraphicsItem *parent)
     }
 
     if (it) {
-      it->acquire();
       features_[i] = it;
       if (!parent)
         document_->addItem(it);
@@ -268,7 +282,6 @@ void Cell::clearGraphicsItems()
 {
   for (int i = 0; i < CELL_COUNT; ++i) {
     if (features_[i]) {
-      features_[i]->release();
       delete features_[i];
       features_[i] = NULL;
     }
@@ -310,6 +323,43 @@ void Cell::addFeature(int feature, const Color *color)
 
   colors_[feature] = color;
   featureMask_ |= featureMaskList[feature];
+
+  if (tracker_) {
+    tracker_->acquire(color, FeatureStitchType(feature));
+    tracker_->touch(pos_);
+  }
+}
+
+void Cell::setColor(int feature, const Color *color)
+{
+  if (!contains(feature))
+    return;
+
+  if (tracker_) {
+    tracker_->release(colors_[feature], FeatureStitchType(feature));
+    tracker_->acquire(color, FeatureStitchType(feature));
+    tracker_->touch(pos_);
+  }
+  colors_[feature] = color;
+}
+
+void Cell::setTracker(ColorUsageTracker *tracker)
+{
+  if (tracker == tracker_)
+    return;
+
+  for (int i = 0; i < CELL_COUNT; ++i) {
+    if (!contains(i))
+      continue;
+    if (tracker_)
+      tracker_->release(colors_[i], FeatureStitchType(i));
+    if (tracker)
+      tracker->acquire(colors_[i], FeatureStitchType(i));
+  }
+
+  if (tracker && featureMask_)
+    tracker->touch(pos_);
+  tracker_ = tracker;
 }
 
 int Cell::affectedFeatures(int feature)
@@ -8,6 +8,7 @@
 class QGraphicsItem;
 
 class Color;
+class ColorUsageTracker;
 class Document;
 class DocumentIo;
 
@@ -73,6 +74,7 @@ enum Subarea
 };
 
 bool FeatureMaskTest(int mask, int feature);
+StitchType FeatureStitchType(int feature);
 
 class Cell
 {
@@ -97,6 +99,11 @@ class Cell
   void merge(const Cell &other);
 
   void addFeature(int feature, const Color *color);
+  void setColor(int feature, const Color *color);
+
+  /* reports all present and future features to the tracker; set on
+   * cells of a document's own map only */
+  void setTracker(ColorUsageTracker *tracker);
 
   int featureMask() const { return featureMask_; }
   bool contains(int feature) const;
@@ -120,6 +127,7 @@ class Cell
   int featureMask_;
 
   Document *document_;
+  ColorUsageTracker *tracker_;
 
   friend class DocumentIoV1;
 };
@@ -3,29 +3,28 @@
 Color Color::defaultColor = Color("Default Color", "nil", QColor("#000000"));
 
 Color::Color()
-    : parent_(NULL)
+    : parent_(NULL), brush_(NULL)
 {
   
 }
 
 Color::Color(const QString &name, const QString &id, const QColor &color)
-    : parent_(NULL), id_(id), name_(name), color_(color)
+    : parent_(NULL), id_(id), name_(name), color_(color), brush_(NULL)
 {
-  brush_ = QBrush(color_);
 }
 
 Color::Color(const Color &other)
+    : brush_(NULL)
 {
   parent_ = other.parent();
   id_ = other.id();
   name_ = other.name();
   color_ = other.color();
-  brush_ = QBrush(color_);
 }
 
 Color::~Color()
 {
-  
+  delete brush_;
 }
 
 Color& Color::operator=(const Color &other)
@@ -34,7 +33,16 @@ Color& Color::operator=(const Color &other)
   id_ = other.id();
   name_ = other.name();
   color_ = other.color();
-  brush_ = QBrush(color_);
+  delete brush_;
+  brush_ = NULL;
 
   return *this;
 }
+
+const QBrush& Color::brush() const
+{
+  if (!brush_)
+    brush_ = new QBrush(color_);
+
+  return *brush_;
+}
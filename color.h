@@ -24,7 +24,8 @@ class Color
   const QString& id() const { return id_; }
   
   const QColor& color() const { return color_; }
-  const QBrush& brush() const { return brush_; }
+  /* created on first use, most colors of a table are never painted */
+  const QBrush& brush() const;
   byte red() const { return color_.red(); }
   byte green() const { return color_.green(); }
   byte blue() const { return color_.blue(); }
@@ -39,7 +40,7 @@ class Color
   QString id_;
   QString name_;
   QColor color_;
-  QBrush brush_;
+  mutable QBrush *brush_;
 };
 
 #endif
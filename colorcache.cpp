@@ -0,0 +1,132 @@
+#include <vector>
+
+#include "color.h"
+#include "kdtree.h"
+#include "linearsearch.h"
+
+#include "colorcache.h"
+
+#define CORNER_SIZE (CACHE_SIZE + 1)
+
+static inline int binIndex(int r, int g, int b)
+{
+  return (r << (CACHE_BITS * 2)) | (g << CACHE_BITS) | b;
+}
+
+static inline int cornerIndex(int r, int g, int b)
+{
+  return (r * CORNER_SIZE + g) * CORNER_SIZE + b;
+}
+
+static inline byte cornerValue(int i)
+{
+  int v = i << CACHE_SHIFT;
+  return v > 255 ? 255 : v;
+}
+
+ColorLookupCache::ColorLookupCache(const QVector<const Color *> &colors,
+                                   const QColor *transparentColor)
+{
+  transparent_ = NULL;
+  tree_ = NULL;
+  linear_ = NULL;
+
+  ColorList v;
+  foreach (const Color *c, colors) {
+    if (!transparentColor || c->color() != *transparentColor)
+      v.push_back(c);
+  }
+  if (transparentColor) {
+    transparent_ = new Color("Transparent color", "transparent", *transparentColor);
+    v.push_back(transparent_);
+  }
+
+  empty_ = v.empty();
+  if (v.size() <= LINEAR_SEARCH_LIMIT)
+    linear_ = new LinearColorSearch(QVector<const Color *>::fromStdVector(v));
+  else
+    tree_ = new KdTree(v.begin(), v.end());
+
+  build();
+}
+
+ColorLookupCache::~ColorLookupCache()
+{
+  if (tree_)
+    delete tree_;
+  if (linear_)
+    delete linear_;
+
+  if (transparent_)
+    delete transparent_;
+}
+
+const Color* ColorLookupCache::nearest(QRgb rgb) const
+{
+  return nearest(qRed(rgb), qGreen(rgb), qBlue(rgb));
+}
+
+const Color* ColorLookupCache::nearest(byte red, byte green, byte blue) const
+{
+  const Color *c = table_[binIndex(red >> CACHE_SHIFT,
+                                   green >> CACHE_SHIFT,
+                                   blue >> CACHE_SHIFT)];
+  if (c)
+    return c;
+
+  return search(red, green, blue);
+}
+
+bool ColorLookupCache::hasTransparent(const QColor *color) const
+{
+  if (!color || !transparent_)
+    return !color && !transparent_;
+
+  return transparent_->color() == *color;
+}
+
+void ColorLookupCache::build()
+{
+  table_.fill(NULL, CACHE_SIZE * CACHE_SIZE * CACHE_SIZE);
+
+  if (empty_)
+    return;
+
+  /* nearest colors of the bin corners, shared between adjacent bins */
+  QVector<const Color *> corners(CORNER_SIZE * CORNER_SIZE * CORNER_SIZE);
+  for (int r = 0; r < CORNER_SIZE; ++r) {
+    for (int g = 0; g < CORNER_SIZE; ++g) {
+      for (int b = 0; b < CORNER_SIZE; ++b) {
+        corners[cornerIndex(r, g, b)] =
+            search(cornerValue(r), cornerValue(g), cornerValue(b));
+      }
+    }
+  }
+
+  for (int r = 0; r < CACHE_SIZE; ++r) {
+    for (int g = 0; g < CACHE_SIZE; ++g) {
+      for (int b = 0; b < CACHE_SIZE; ++b) {
+        const Color *c = corners[cornerIndex(r, g, b)];
+
+        if (corners[cornerIndex(r + 1, g, b)] != c ||
+            corners[cornerIndex(r, g + 1, b)] != c ||
+            corners[cornerIndex(r, g, b + 1)] != c ||
+            corners[cornerIndex(r + 1, g + 1, b)] != c ||
+            corners[cornerIndex(r + 1, g, b + 1)] != c ||
+            corners[cornerIndex(r, g + 1, b + 1)] != c ||
+            corners[cornerIndex(r + 1, g + 1, b + 1)] != c)
+          continue;
+
+        table_[binIndex(r, g, b)] = c;
+      }
+    }
+  }
+}
+
+const Color* ColorLookupCache::search(byte red, byte green, byte blue) const
+{
+  if (linear_)
+    return linear_->nearest(red, green, blue);
+
+  return tree_->nearest(red, green, blue);
+}
@@ -0,0 +1,54 @@
+#ifndef _COLORCACHE_H_
+#define _COLORCACHE_H_
+
+#include <QColor>
+#include <QVector>
+
+#include "common.h"
+
+class Color;
+class KdTree;
+class LinearColorSearch;
+
+#define CACHE_BITS  5
+#define CACHE_SIZE  (1 << CACHE_BITS)
+#define CACHE_SHIFT (8 - CACHE_BITS)
+
+/* Quantized RGB -> color lookup table.
+ *
+ * The RGB cube is split into CACHE_SIZE^3 bins. A bin is resolved to a
+ * single color when all eight corners of its box share the same nearest
+ * color; since nearest-neighbour regions are convex, every color inside
+ * the box maps to it as well. Ambiguous bins fall back to a full search,
+ * which is a linear scan for small palettes and a kd-tree otherwise.
+ *
+ * The table is immutable once built, so one instance can be shared
+ * between threads. */
+class ColorLookupCache
+{
+ public:
+  ColorLookupCache(const QVector<const Color *> &colors,
+                   const QColor *transparentColor = NULL);
+  ~ColorLookupCache();
+
+  const Color* nearest(QRgb rgb) const;
+  const Color* nearest(byte red, byte green, byte blue) const;
+
+  const Color* transparent() const { return transparent_; }
+  bool hasTransparent(const QColor *color) const;
+
+  bool isEmpty() const { return empty_; }
+
+ private:
+  void build();
+  const Color* search(byte red, byte green, byte blue) const;
+
+ private:
+  KdTree *tree_;
+  LinearColorSearch *linear_;
+  Color *transparent_;
+  bool empty_;
+  QVector<const Color *> table_;
+};
+
+#endif
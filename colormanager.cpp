@@ -5,11 +5,15 @@
 #include <qjson/parser.h>
 
 #include "color.h"
+#include "colorcache.h"
+#include "palettecache.h"
 #include "settings.h"
-#include "stitch.h"
 
 #include "colormanager.h"
 
+/* lookup tables kept per color set, one per transparent color */
+#define LOOKUP_CACHE_LIMIT 4
+
 ColorManager::ColorManager(QObject *parent)
     : QObject(parent), name_(QObject::tr("My Colors"))
 {
@@ -80,7 +84,10 @@ void ColorManager::add(const Color *c)
   if (!colorMap_.contains(c->id())) {
     colorMap_.insert(c->id(), c);
     emit colorAppended();
+    cacheLock_.lock();
     colorList_.append(colorMap_[c->id()]);
+    cacheLock_.unlock();
+    invalidateLookupCache();
     emit listChanged();
   }
 }
@@ -90,7 +97,10 @@ void ColorManager::insert(const Color *c, int before)
   if (!colorMap_.contains(c->id())) {
     colorMap_.insert(c->id(), c);
     emit colorInserted(before);
+    cacheLock_.lock();
     colorList_.insert(before, colorMap_[c->id()]);
+    cacheLock_.unlock();
+    invalidateLookupCache();
     emit listChanged();
   }
 }
@@ -103,11 +113,14 @@ void ColorManager::remove(const QString &id)
 
   int index = colorList_.indexOf(*it);
   if (index >= 0) {
+    cacheLock_.lock();
     colorList_.remove(index);
+    cacheLock_.unlock();
     emit colorDeleted(index);
   }
   
   colorMap_.erase(it);
+  invalidateLookupCache();
 
   emit listChanged();
 }
@@ -120,9 +133,11 @@ void ColorManager::swap(int index1, int index2)
   if (index1 >= size || index2 >= size)
     return;
 
+  cacheLock_.lock();
   temp = colorList_[index1];
   colorList_[index1] = colorList_[index2];
   colorList_[index2] = temp;
+  cacheLock_.unlock();
 
   emit listChanged();
   emit colorSwapped(index1, index2);
@@ -153,11 +168,59 @@ int ColorManager::count() const
 void ColorManager::clear()
 {
   colorMap_.clear();
+  cacheLock_.lock();
   colorList_.clear();
+  cacheLock_.unlock();
+  invalidateLookupCache();
+}
+
+ColorLookupCachePtr ColorManager::lookupCache(const QColor *transparentColor) const
+{
+  QMutexLocker locker(&cacheLock_);
+
+  for (int i = 0; i < lookupCaches_.size(); ++i) {
+    ColorLookupCachePtr cache = lookupCaches_[i];
+    if (cache->hasTransparent(transparentColor)) {
+      lookupCaches_.move(i, 0);
+      return cache;
+    }
+  }
+
+  ColorLookupCachePtr cache(new ColorLookupCache(colorList_, transparentColor));
+  lookupCaches_.prepend(cache);
+  while (lookupCaches_.size() > LOOKUP_CACHE_LIMIT)
+    lookupCaches_.removeLast();
+
+  return cache;
+}
+
+void ColorManager::invalidateLookupCache()
+{
+  QMutexLocker locker(&cacheLock_);
+
+  lookupCaches_.clear();
+}
+
+static const int stitchWeights[StitchType_Count] = { 8, 4, 2, 1 };
+
+StitchCounts::StitchCounts()
+{
+  for (int i = 0; i < StitchType_Count; ++i)
+    count[i] = 0;
+}
+
+int StitchCounts::total() const
+{
+  int sum = 0;
+  for (int i = 0; i < StitchType_Count; ++i)
+    sum += count[i];
+
+  return sum;
 }
 
 ColorUsageTracker::ColorUsageTracker(QObject *parent)
-    : ColorManager(parent), total_(0.0)
+    : ColorManager(parent), total_(0.0), dirty_(false), listDirty_(false),
+      recording_(false)
 {
 }
 
@@ -166,39 +229,131 @@ ColorUsageTracker::~ColorUsageTracker()
 
 }
 
-void ColorUsageTracker::acquire(StitchItem *item)
+void ColorUsageTracker::setRecording(bool recording)
 {
-  const Color *key = item->color();
-  backrefMap_[key].insert(item);
-  weightMap_[key] += item->weight();
-  total_ += item->weight();
-  const Color *c = item->color();
-  if (colorMap_.find(c->id()) == colorMap_.end())
-    add(c);
+  recording_ = recording;
+}
+
+QVector<QPoint> ColorUsageTracker::takeTouched()
+{
+  QVector<QPoint> touched = touched_;
+  touched_.clear();
+
+  return touched;
 }
 
-void ColorUsageTracker::release(StitchItem *item)
+void ColorUsageTracker::acquire(const Color *color, StitchType type)
 {
-  const Color *key = item->color();
-  QSet<StitchItem *> &set = backrefMap_[key];
-  total_ -= item->weight();
-  weightMap_[key] -= item->weight();
-  set.remove(item);
-  if (set.size() == 0) {
-    remove(item->color()->id());
-    weightMap_.remove(key);
-    backrefMap_.remove(key);
+  if (!color)
+    return;
+
+  total_ += stitchWeights[type];
+  ++totalCounts_.count[type];
+  changed_.insert(color);
+
+  StitchCounts &counts = counts_[color];
+  bool added = counts.total() == 0;
+  ++counts.count[type];
+
+  if (added) {
+    if (!colorMap_.contains(color->id()))
+      colorMap_.insert(color->id(), color);
+    cacheLock_.lock();
+    colorList_.append(color);
+    cacheLock_.unlock();
   }
+
+  setDirty(added);
 }
 
-const QSet<StitchItem *>* ColorUsageTracker::items(const Color *color) const
+void ColorUsageTracker::release(const Color *color, StitchType type)
 {
-  BackRefMap::ConstIterator it = backrefMap_.find(color);
+  if (!color)
+    return;
 
-  if (it == backrefMap_.end())
-    return NULL;
+  QHash<const Color *, StitchCounts>::Iterator it = counts_.find(color);
+  if (it == counts_.end() || it.value().count[type] == 0)
+    return;
+
+  total_ -= stitchWeights[type];
+  --totalCounts_.count[type];
+  --it.value().count[type];
+  changed_.insert(color);
+
+  if (it.value().total() > 0) {
+    setDirty(false);
+    return;
+  }
+
+  counts_.erase(it);
+
+  QHash<QString, const Color *>::Iterator mit = colorMap_.find(color->id());
+  if (mit != colorMap_.end() && mit.value() == color)
+    colorMap_.erase(mit);
+
+  int index = colorList_.indexOf(color);
+  if (index >= 0) {
+    cacheLock_.lock();
+    colorList_.remove(index);
+    cacheLock_.unlock();
+  }
+  setDirty(true);
+}
+
+int ColorUsageTracker::uses(const Color *color) const
+{
+  return counts(color).total();
+}
+
+StitchCounts ColorUsageTracker::counts(const Color *color) const
+{
+  return counts_.value(color);
+}
+
+int ColorUsageTracker::weight(const Color *color) const
+{
+  StitchCounts c = counts(color);
+
+  int sum = 0;
+  for (int i = 0; i < StitchType_Count; ++i)
+    sum += c.count[i] * stitchWeights[i];
 
-  return &(*it);
+  return sum;
+}
+
+void ColorUsageTracker::flush()
+{
+  if (!dirty_)
+    return;
+
+  bool listChanged = listDirty_;
+  dirty_ = false;
+  listDirty_ = false;
+
+  if (listChanged) {
+    emit listReset();
+    emit this->listChanged();
+  }
+  emit usageChanged();
+
+  changed_.clear();
+}
+
+void ColorUsageTracker::setDirty(bool listChanged)
+{
+  /* a cache built since the last change is already out of date */
+  if (listChanged) {
+    listDirty_ = true;
+    invalidateLookupCache();
+  }
+
+  if (dirty_)
+    return;
+
+  dirty_ = true;
+
+  /* picked up by the event loop unless an edit flushes earlier */
+  QMetaObject::invokeMethod(this, "flush", Qt::QueuedConnection);
 }
 
 MetaColorManager::MetaColorManager(QObject *parent)
@@ -213,13 +368,20 @@ MetaColorManager::MetaColorManager(const QString &path, QObject *parent)
   QFile file(path);
   if (!file.open(QIODevice::ReadOnly))
     qFatal("Could not open color table!");
-  QTextStream stream(&file);
-  QString jsonText = stream.readAll();
+  QByteArray json = file.readAll();
   file.close();
-  
+
+  QByteArray digest = PaletteCache::digest(json);
+  PaletteCache cache(PaletteCache::defaultPath(path));
+  if (cache.load(digest, this)) {
+    registerColors();
+    populateMyColors();
+    return;
+  }
+
   QJson::Parser parser;
   bool ok;
-  QVariant result = parser.parse(jsonText.toUtf8(), &ok);
+  QVariant result = parser.parse(json, &ok);
   if (!ok) {
     qFatal("Could not read color table!");
   }
@@ -231,6 +393,10 @@ MetaColorManager::MetaColorManager(const QString &path, QObject *parent)
     cm->load(map["colors"]);
   }
 
+  if (!cache.save(digest, this))
+    qWarning("Could not write palette cache %s", qPrintable(cache.path()));
+
+  registerColors();
   populateMyColors();
 }
 
@@ -256,14 +422,51 @@ void MetaColorManager::populateMyColors()
   }
 }
 
-const Color* MetaColorManager::get(const QString &category, const QString &id)
+const Color* MetaColorManager::get(const QString &category,
+                                   const QString &id) const
 {
-  QHash<QString, ColorManager *>::Iterator it = colorManagers_.find(category);
+  return color(handle(category, id));
+}
 
-  if (it == colorManagers_.end())
+ColorHandle MetaColorManager::handle(const QString &category,
+                                     const QString &id) const
+{
+  return keys_.value(ColorKey(category, id), COLOR_HANDLE_NONE);
+}
+
+ColorHandle MetaColorManager::handle(const Color *color) const
+{
+  return handles_.value(color, COLOR_HANDLE_NONE);
+}
+
+const Color* MetaColorManager::color(ColorHandle handle) const
+{
+  if (handle < 0 || handle >= registry_.size())
     return NULL;
 
-  return it.value()->get(id);
+  return registry_[handle];
+}
+
+void MetaColorManager::registerColors()
+{
+  registry_.clear();
+  keys_.clear();
+  handles_.clear();
+
+  foreach (const ColorManager *cm, colorManagerList_) {
+    foreach (const Color *c, cm->colorList()) {
+      /* the table's own lookup wins for duplicate ids */
+      if (cm->get(c->id()) != c)
+        continue;
+
+      ColorKey key(cm->id(), c->id());
+
+      ColorHandle handle = registry_.size();
+      registry_.append(c);
+      keys_.insert(key, handle);
+      handles_.insert(c, handle);
+    }
+  }
 }
 
 ColorManager* MetaColorManager::createColorManager(const QString &id,
@@ -290,3 +493,21 @@ ColorManager* MetaColorManager::colorManager(const QString &id)
 
   return NULL;
 }
+
+ColorResolver::ColorResolver(const MetaColorManager *meta)
+    : meta_(meta), last_(NULL)
+{
+}
+
+const Color* ColorResolver::resolve(const QString &category,
+                                    const QString &id)
+{
+  if (last_ && id == id_ && category == category_)
+    return last_;
+
+  category_ = category;
+  id_ = id;
+  last_ = meta_->get(category, id);
+
+  return last_;
+}
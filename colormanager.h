@@ -2,15 +2,25 @@
 #define _COLORMANAGER_H_
 
 #include <QHash>
+#include <QMutex>
 #include <QObject>
+#include <QPair>
+#include <QPoint>
 #include <QSet>
+#include <QSharedPointer>
 #include <QVector>
 
 #include "color.h"
+#include "stitch.h"
 
 #define COLOR_TABLE ":/res/colors.json"
 
-class StitchItem;
+class ColorLookupCache;
+
+typedef QSharedPointer<const ColorLookupCache> ColorLookupCachePtr;
+
+/* replacement color per color */
+typedef QHash<const Color *, const Color *> ColorMapping;
 
 class ColorManager : public QObject
 {
@@ -43,8 +53,11 @@ class ColorManager : public QObject
 
   const QVector<const Color *>& colorList() const { return colorList_; }
 
+  ColorLookupCachePtr lookupCache(const QColor *transparentColor = NULL) const;
+
  signals:
   void listChanged();
+  void listReset();
   void colorAppended();
   void colorInserted(int before);
   void colorDeleted(int index);
@@ -56,31 +69,104 @@ class ColorManager : public QObject
   QHash<QString, const Color *> colorMap_;
   QVector<const Color *> colorList_;
 
+  void invalidateLookupCache();
+
+  /* lookupCache() may run on worker threads and reads colorList_ under
+   * this lock, so every change of the list takes it as well */
+  mutable QMutex cacheLock_;
+
  private:
   bool isDependent_;
+
+  mutable QList<ColorLookupCachePtr> lookupCaches_;
 };
 
-typedef QHash<const Color *, QSet<StitchItem *> > BackRefMap;
-typedef QHash<const Color *, int> WeightMap;
+struct StitchCounts
+{
+  StitchCounts();
+
+  int total() const;
+
+  int count[StitchType_Count];
+};
 
+/* Colors used by a document.
+ *
+ * Cells of the document map report every feature they gain or lose, and
+ * the tracker keeps per-color stitch counts by type, so usage figures are
+ * maintained in time proportional to the edit. The color list is kept
+ * current, but signals are held back until flush(), which runs once the
+ * current edit is done or at the next event loop pass, so a load or import
+ * of a large chart resets the palette views only once. */
 class ColorUsageTracker : public ColorManager
 {
+  Q_OBJECT;
+
  public:
   ColorUsageTracker(QObject *parent = NULL);
   ~ColorUsageTracker();
 
-  void acquire(StitchItem *item);
-  void release(StitchItem *item);
+  void acquire(const Color *color, StitchType type);
+  void release(const Color *color, StitchType type);
+
+  /* number of features using the color */
+  int uses(const Color *color) const;
+  StitchCounts counts(const Color *color) const;
+
+  /* stitch weights in quarter-stitch units */
+  int weight(const Color *color) const;
+  qreal total() const { return total_; }
+
+  /* counts over all colors */
+  const StitchCounts& totalCounts() const { return totalCounts_; }
+
+  /* colors whose counts changed since the last flush, valid while
+   * usageChanged() is being delivered */
+  const QSet<const Color *>& changedColors() const { return changed_; }
+
+  /* While recording, cells of the document map also report their
+   * position whenever they change; the journal takes them after every
+   * edit. Loading cells is not recorded. */
+  void setRecording(bool recording);
+  bool isRecording() const { return recording_; }
+  void touch(const QPoint &pos) { if (recording_) touched_.append(pos); }
+
+  /* positions reported since the last call, possibly repeated */
+  QVector<QPoint> takeTouched();
+
+ signals:
+  /* counts changed, sent on flush() */
+  void usageChanged();
+
+ public slots:
+  void flush();
 
-  const BackRefMap& backrefMap() const { return backrefMap_; }
-  const QSet<StitchItem *>* items(const Color *) const;
+ private:
+  void setDirty(bool listChanged);
 
  private:
-  BackRefMap backrefMap_;
-  WeightMap weightMap_;
+  QHash<const Color *, StitchCounts> counts_;
+  QSet<const Color *> changed_;
+  StitchCounts totalCounts_;
   qreal total_;
+  bool dirty_;
+  bool listDirty_;
+
+  bool recording_;
+  QVector<QPoint> touched_;
 };
 
+/* dense index of a color in the MetaColorManager registry */
+typedef int ColorHandle;
+
+#define COLOR_HANDLE_NONE -1
+
+/* Every color of the loaded color tables.
+ *
+ * Once the tables are loaded, each color is given a dense integer handle.
+ * Strings identify colors only at file and clipboard boundaries; they are
+ * turned into handles with one lookup, and handles turn into colors by
+ * indexing. */
 class MetaColorManager : public QObject
 {
  public:
@@ -90,7 +176,12 @@ class MetaColorManager : public QObject
 
   void populateMyColors();
 
-  const Color* get(const QString &category, const QString &id);
+  const Color* get(const QString &category, const QString &id) const;
+
+  ColorHandle handle(const QString &category, const QString &id) const;
+  ColorHandle handle(const Color *color) const;
+  const Color* color(ColorHandle handle) const;
+  int handleCount() const { return registry_.size(); }
 
   ColorManager* createColorManager(const QString &id, const QString &name);
   ColorManager* colorManager(const QString &id);
@@ -98,9 +189,37 @@ class MetaColorManager : public QObject
   QList<ColorManager *>& colorManagers() { return colorManagerList_; }
 
  private:
+  void registerColors();
+
+ private:
+  typedef QPair<QString, QString> ColorKey;
+
   QList<ColorManager *> colorManagerList_;
   QHash<QString, ColorManager *> colorManagers_;
   ColorManager localSwatches_;
+
+  QVector<const Color *> registry_;
+  QHash<ColorKey, ColorHandle> keys_;
+  QHash<const Color *, ColorHandle> handles_;
+};
+
+/* Resolves (category, id) pairs read from files or clipboard data.
+ *
+ * Neighbouring stitches mostly share their color, so the last pair
+ * resolved is compared first and only a change of color goes to the
+ * registry. */
+class ColorResolver
+{
+ public:
+  ColorResolver(const MetaColorManager *meta);
+
+  const Color* resolve(const QString &category, const QString &id);
+
+ private:
+  const MetaColorManager *meta_;
+  QString category_;
+  QString id_;
+  const Color *last_;
 };
 
 #endif
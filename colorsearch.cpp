@@ -0,0 +1,233 @@
+#include <QRegExp>
+#include <QSet>
+#include <QStringList>
+#include <QtAlgorithms>
+
+#include "color.h"
+#include "colorcache.h"
+
+#include "colorsearch.h"
+
+/* PrefixIndex */
+
+PrefixIndex::PrefixIndex()
+{
+
+}
+
+PrefixIndex::~PrefixIndex()
+{
+
+}
+
+void PrefixIndex::add(const QString &key, ColorHandle handle)
+{
+  Entry entry;
+  entry.key = key;
+  entry.handle = handle;
+  entries_.append(entry);
+}
+
+void PrefixIndex::build()
+{
+  qSort(entries_);
+
+  Node root;
+  root.c = 0;
+  root.children = 0;
+  root.childCount = 0;
+  root.begin = 0;
+  root.end = entries_.size();
+
+  nodes_.clear();
+  nodes_.append(root);
+  fill(0, 0);
+}
+
+void PrefixIndex::fill(int node, int depth)
+{
+  int i = nodes_[node].begin;
+  int end = nodes_[node].end;
+
+  /* keys ending here sort first */
+  while (i < end && entries_[i].key.size() == depth)
+    ++i;
+
+  int first = nodes_.size();
+  while (i < end) {
+    ushort c = entries_[i].key[depth].unicode();
+    int j = i + 1;
+    while (j < end && entries_[j].key[depth].unicode() == c)
+      ++j;
+
+    Node child;
+    child.c = c;
+    child.children = 0;
+    child.childCount = 0;
+    child.begin = i;
+    child.end = j;
+    nodes_.append(child);
+
+    i = j;
+  }
+
+  int count = nodes_.size() - first;
+  nodes_[node].children = first;
+  nodes_[node].childCount = count;
+
+  for (int k = first; k < first + count; ++k)
+    fill(k, depth + 1);
+}
+
+void PrefixIndex::find(const QString &prefix, int &begin, int &end) const
+{
+  begin = end = 0;
+  if (nodes_.isEmpty())
+    return;
+
+  int node = 0;
+  for (int i = 0; i < prefix.size(); ++i) {
+    ushort c = prefix[i].unicode();
+
+    int lo = nodes_[node].children;
+    int hi = lo + nodes_[node].childCount;
+    while (lo < hi) {
+      int mid = (lo + hi) / 2;
+      if (nodes_[mid].c < c)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+
+    if (lo == nodes_[node].children + nodes_[node].childCount ||
+        nodes_[lo].c != c)
+      return;
+
+    node = lo;
+  }
+
+  begin = nodes_[node].begin;
+  end = nodes_[node].end;
+}
+
+/* ColorSearchIndex */
+
+ColorSearchIndex::ColorSearchIndex(MetaColorManager *meta)
+    : meta_(meta)
+{
+  for (ColorHandle h = 0; h < meta_->handleCount(); ++h) {
+    const Color *c = meta_->color(h);
+    ids_.add(c->id().toLower(), h);
+
+    /* every word starts a key, so fragments from the middle of a name
+     * match as well */
+    QString name = c->name().toLower().simplified();
+    int from = 0;
+    while (from >= 0 && from < name.size()) {
+      names_.add(name.mid(from), h);
+
+      from = name.indexOf(' ', from);
+      if (from >= 0)
+        ++from;
+    }
+  }
+
+  ids_.build();
+  names_.build();
+}
+
+ColorSearchIndex::~ColorSearchIndex()
+{
+
+}
+
+QVector<const Color *> ColorSearchIndex::search(const QString &query,
+                                                int limit) const
+{
+  QVector<const Color *> results;
+  QSet<const Color *> seen;
+
+  QString key = query.toLower().simplified();
+  if (key.isEmpty())
+    return results;
+
+  /* the nearest color of every set comes first */
+  QColor rgb;
+  if (parseColor(key, rgb)) {
+    foreach (const ColorManager *cm, meta_->colorManagers()) {
+      ColorLookupCachePtr cache = cm->lookupCache();
+      if (cache->isEmpty())
+        continue;
+
+      const Color *c = cache->nearest(rgb.rgb());
+      if (!seen.contains(c)) {
+        seen.insert(c);
+        results.append(c);
+      }
+    }
+  }
+
+  const PrefixIndex *indexes[] = { &ids_, &names_ };
+  for (int i = 0; i < 2 && results.size() < limit; ++i) {
+    int begin, end;
+    indexes[i]->find(key, begin, end);
+
+    for (int j = begin; j < end && results.size() < limit; ++j) {
+      const Color *c = meta_->color(indexes[i]->handle(j));
+      if (!seen.contains(c)) {
+        seen.insert(c);
+        results.append(c);
+      }
+    }
+  }
+
+  return results;
+}
+
+bool ColorSearchIndex::parseColor(const QString &query, QColor &color)
+{
+  if (query.startsWith('#')) {
+    if (query.size() != 4 && query.size() != 7)
+      return false;
+
+    color.setNamedColor(query);
+    return color.isValid();
+  }
+
+  QRegExp rgb("(\\d{1,3})\\s*[, ]\\s*(\\d{1,3})\\s*[, ]\\s*(\\d{1,3})");
+  if (!rgb.exactMatch(query))
+    return false;
+
+  int r = rgb.cap(1).toInt();
+  int g = rgb.cap(2).toInt();
+  int b = rgb.cap(3).toInt();
+  if (r > 255 || g > 255 || b > 255)
+    return false;
+
+  color.setRgb(r, g, b);
+  return true;
+}
+
+/* ColorSearchResults */
+
+ColorSearchResults::ColorSearchResults(QObject *parent)
+    : ColorManager(QString(), QObject::tr("Search Results"), parent)
+{
+  setDependent(true);
+}
+
+ColorSearchResults::~ColorSearchResults()
+{
+
+}
+
+void ColorSearchResults::setResults(const QVector<const Color *> &colors)
+{
+  cacheLock_.lock();
+  colorList_ = colors;
+  cacheLock_.unlock();
+  invalidateLookupCache();
+
+  emit listReset();
+  emit listChanged();
+}
@@ -0,0 +1,89 @@
+#ifndef _COLORSEARCH_H_
+#define _COLORSEARCH_H_
+
+#include <QString>
+#include <QVector>
+
+#include "colormanager.h"
+
+/* results shown per query */
+#define SEARCH_RESULT_LIMIT 100
+
+/* Sorted keys with a prefix trie on top.
+ *
+ * Every trie node covers the contiguous range of keys that start with its
+ * prefix, and the children of a node are stored next to each other sorted
+ * by character, so a query is one binary search per character and the
+ * matches are read off as a range. */
+class PrefixIndex
+{
+ public:
+  PrefixIndex();
+  ~PrefixIndex();
+
+  void add(const QString &key, ColorHandle handle);
+  void build();
+
+  /* range of entries starting with the prefix, empty if none */
+  void find(const QString &prefix, int &begin, int &end) const;
+  ColorHandle handle(int index) const { return entries_[index].handle; }
+
+ private:
+  struct Entry
+  {
+    QString key;
+    ColorHandle handle;
+
+    bool operator<(const Entry &other) const { return key < other.key; }
+  };
+
+  struct Node
+  {
+    ushort c;
+    int children;
+    int childCount;
+    int begin;
+    int end;
+  };
+
+  void fill(int node, int depth);
+
+ private:
+  QVector<Entry> entries_;
+  QVector<Node> nodes_;
+};
+
+/* Lookup of colors across all color sets by id, by name fragment or by
+ * nearness to an RGB value. The indexes are built once from the registry
+ * of the MetaColorManager; nearness queries go through the lookup cache
+ * of each set. */
+class ColorSearchIndex
+{
+ public:
+  ColorSearchIndex(MetaColorManager *meta);
+  ~ColorSearchIndex();
+
+  QVector<const Color *> search(const QString &query,
+                                int limit = SEARCH_RESULT_LIMIT) const;
+
+  /* accepts "#rgb", "#rrggbb" and "r, g, b" */
+  static bool parseColor(const QString &query, QColor &color);
+
+ private:
+  MetaColorManager *meta_;
+  PrefixIndex ids_;
+  PrefixIndex names_;
+};
+
+/* A color list holding search results, which may contain equal ids from
+ * different sets. */
+class ColorSearchResults : public ColorManager
+{
+ public:
+  ColorSearchResults(QObject *parent = NULL);
+  ~ColorSearchResults();
+
+  void setResults(const QVector<const Color *> &colors);
+};
+
+#endif
@@ -0,0 +1,216 @@
+#include <QList>
+#include <QThreadPool>
+#include <QtConcurrentMap>
+
+#include "cell.h"
+#include "color.h"
+#include "document.h"
+#include "sparsemap.h"
+
+#include "confetticleaner.h"
+
+/* rows per labelling strip, at least */
+#define LABEL_STRIP_MIN_ROWS 64
+
+struct LabelStrip
+{
+  ConfettiCleaner *cleaner;
+  int begin;
+  int end;
+};
+
+static inline int colorDistance(const Color *a, const Color *b)
+{
+  int dr = a->red() - b->red();
+  int dg = a->green() - b->green();
+  int db = a->blue() - b->blue();
+
+  return dr * dr + dg * dg + db * db;
+}
+
+ConfettiCleaner::ConfettiCleaner(Document *document)
+    : size_(document->size())
+{
+  grid_.fill(NULL, size_.width() * size_.height());
+
+  const CellMap &cells = document->map()->cells();
+  for (CellMap::ConstIterator it = cells.begin(); it != cells.end(); ++it) {
+    const QPoint &pos = it.key();
+    const Cell *cell = it.value();
+
+    if (cell->featureMask() != MASK_CELL_FULL ||
+        pos.x() < 0 || pos.x() >= size_.width() ||
+        pos.y() < 0 || pos.y() >= size_.height())
+      continue;
+
+    grid_[pos.y() * size_.width() + pos.x()] = cell->color(CELL_FULL);
+  }
+}
+
+ConfettiCleaner::~ConfettiCleaner()
+{
+
+}
+
+int ConfettiCleaner::run(int minimumSize)
+{
+  positions_.clear();
+  from_.clear();
+  to_.clear();
+
+  int width = size_.width();
+  int count = grid_.size();
+  if (!count)
+    return 0;
+
+  label();
+
+  /* parents always point to lower indices, so one ascending pass leaves
+   * every cell pointing at its root */
+  QVector<int> sizes(count, 0);
+  int *parent = parent_.data();
+  for (int i = 0; i < count; ++i) {
+    if (!grid_[i])
+      continue;
+    parent[i] = parent[parent[i]];
+    ++sizes[parent[i]];
+  }
+
+  QVector<const Color *> best(count, NULL);
+  QVector<int> bestDistance(count, 0);
+
+  for (int i = 0; i < count; ++i) {
+    const Color *c = grid_[i];
+    int root = parent[i];
+    if (!c || sizes[root] >= minimumSize)
+      continue;
+
+    int x = i % width;
+    int neighbours[4] = {
+      x > 0 ? i - 1 : -1,
+      x < width - 1 ? i + 1 : -1,
+      i - width,
+      i + width
+    };
+
+    for (int n = 0; n < 4; ++n) {
+      int j = neighbours[n];
+      if (j < 0 || j >= count || !grid_[j] || grid_[j] == c)
+        continue;
+
+      /* taking the color of other confetti would only swap colors */
+      if (sizes[parent[j]] < minimumSize)
+        continue;
+
+      int d = colorDistance(c, grid_[j]);
+      if (!best[root] || d < bestDistance[root]) {
+        best[root] = grid_[j];
+        bestDistance[root] = d;
+      }
+    }
+  }
+
+  for (int i = 0; i < count; ++i) {
+    const Color *c = grid_[i];
+    if (!c)
+      continue;
+
+    const Color *target = best[parent[i]];
+    if (!target)
+      continue;
+
+    positions_.append(QPoint(i % width, i / width));
+    from_.append(c);
+    to_.append(target);
+  }
+
+  return positions_.size();
+}
+
+void ConfettiCleaner::label()
+{
+  int height = size_.height();
+  int width = size_.width();
+
+  parent_.resize(grid_.size());
+  int *parent = parent_.data();
+  for (int i = 0; i < parent_.size(); ++i)
+    parent[i] = i;
+
+  int threads = qMax(1, QThreadPool::globalInstance()->maxThreadCount());
+  int rows = qMax(LABEL_STRIP_MIN_ROWS, (height + threads - 1) / threads);
+
+  QList<LabelStrip> strips;
+  for (int y = 0; y < height; y += rows) {
+    LabelStrip strip;
+    strip.cleaner = this;
+    strip.begin = y;
+    strip.end = qMin(y + rows, height);
+    strips.append(strip);
+  }
+
+  /* strips only link cells inside themselves */
+  QtConcurrent::blockingMap(strips, &ConfettiCleaner::labelStripEntry);
+
+  foreach (const LabelStrip &strip, strips) {
+    if (strip.begin == 0)
+      continue;
+
+    int i = strip.begin * width;
+    for (int x = 0; x < width; ++x, ++i) {
+      if (grid_[i] && grid_[i] == grid_[i - width])
+        unite(i, i - width);
+    }
+  }
+}
+
+void ConfettiCleaner::labelStrip(int begin, int end)
+{
+  int width = size_.width();
+
+  for (int y = begin; y < end; ++y) {
+    int i = y * width;
+    for (int x = 0; x < width; ++x, ++i) {
+      const Color *c = grid_[i];
+      if (!c)
+        continue;
+
+      if (x > 0 && grid_[i - 1] == c)
+        unite(i, i - 1);
+      if (y > begin && grid_[i - width] == c)
+        unite(i, i - width);
+    }
+  }
+}
+
+int ConfettiCleaner::find(int i)
+{
+  int *parent = parent_.data();
+
+  while (parent[i] != i) {
+    parent[i] = parent[parent[i]];
+    i = parent[i];
+  }
+
+  return i;
+}
+
+void ConfettiCleaner::unite(int a, int b)
+{
+  a = find(a);
+  b = find(b);
+
+  if (a == b)
+    return;
+
+  /* the lower index becomes the root */
+  if (a < b)
+    parent_.data()[b] = a;
+  else
+    parent_.data()[a] = b;
+}
+
+void ConfettiCleaner::labelStripEntry(LabelStrip &strip)
+{
+  strip.cleaner->labelStrip(strip.begin, strip.end);
+}
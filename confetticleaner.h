@@ -0,0 +1,56 @@
+#ifndef _CONFETTICLEANER_H_
+#define _CONFETTICLEANER_H_
+
+#include <QPoint>
+#include <QSize>
+#include <QVector>
+
+class Color;
+class Document;
+
+struct LabelStrip;
+
+/* Removes "confetti", tiny same-color regions of full stitches.
+ *
+ * The chart is copied into a dense grid and 4-connected regions of equal
+ * color are labelled with union-find: horizontal strips are labelled
+ * concurrently, then the seams between strips are joined. Every region
+ * smaller than the threshold takes the color of its most similar
+ * neighbouring region that is at least as large as the threshold;
+ * confetti surrounded only by other confetti is kept. Cells with partial
+ * stitches are left alone and separate regions like empty cells do.
+ *
+ * run() only computes the changes; they are applied through an
+ * ActionCleanup so the whole pass is a single undo step. */
+class ConfettiCleaner
+{
+ public:
+  ConfettiCleaner(Document *document);
+  ~ConfettiCleaner();
+
+  /* returns the number of cells that change color */
+  int run(int minimumSize);
+
+  const QVector<QPoint>& positions() const { return positions_; }
+  const QVector<const Color *>& from() const { return from_; }
+  const QVector<const Color *>& to() const { return to_; }
+
+ private:
+  void label();
+  void labelStrip(int begin, int end);
+  int find(int i);
+  void unite(int a, int b);
+
+  static void labelStripEntry(LabelStrip &strip);
+
+ private:
+  QSize size_;
+  QVector<const Color *> grid_;
+  QVector<int> parent_;
+
+  QVector<QPoint> positions_;
+  QVector<const Color *> from_;
+  QVector<const Color *> to_;
+};
+
+#endif
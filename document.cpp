@@ -11,6 +11,7 @@
 #include "selection.h"
 #include "selectiongroup.h"
 #include "stitch.h"
+#include "tileloader.h"
 #include "utils.h"
 
 #include "document.h"
@@ -20,12 +21,16 @@ Document::Document(QObject *parent)
 {
   selection_ = NULL;
   floatingSelection_ = NULL;
+  loader_ = NULL;
   changed_ = false;
+  revision_ = 0;
 
   editor_ = new Editor(this);
-  map_ = new SparseMap(this);
+  map_ = new SparseMap(this, &colors_);
 
   connect(editor_, SIGNAL(changed()), this, SLOT(documentChanged_()));
+  connect(editor_, SIGNAL(indexChanged(int)), &colors_, SLOT(flush()));
+  connect(editor_, SIGNAL(indexChanged(int)), this, SLOT(undoIndexChanged_()));
 
   grid_ = NULL;
   resetGrid();
@@ -38,12 +43,16 @@ Document::Document(const QSize &size, QObject *parent)
 {
   selection_ = NULL;
   floatingSelection_ = NULL;
+  loader_ = NULL;
   changed_ = false;
+  revision_ = 0;
 
   editor_ = new Editor(this);
-  map_ = new SparseMap(this);
+  map_ = new SparseMap(this, &colors_);
 
   connect(editor_, SIGNAL(changed()), this, SLOT(documentChanged_()));
+  connect(editor_, SIGNAL(indexChanged(int)), &colors_, SLOT(flush()));
+  connect(editor_, SIGNAL(indexChanged(int)), this, SLOT(undoIndexChanged_()));
 
   grid_ = NULL;
   resetGrid();
@@ -60,6 +69,8 @@ Document::~Document()
   if (floatingSelection_)
     delete floatingSelection_;
 
+  /* stops the loader's worker before the map goes away */
+  delete loader_;
   delete map_;
 }
 
@@ -68,6 +79,34 @@ QRect Document::boundingRect() const
   return QRect(QPoint(0, 0), size_);
 }
 
+void Document::ensureLoaded(const QRect &region)
+{
+  if (loader_)
+    loader_->ensureLoaded(region);
+}
+
+bool Document::isLoaded() const
+{
+  return !loader_ || loader_->isLoaded();
+}
+
+void Document::setTileLoader(TileLoader *loader)
+{
+  delete loader_;
+  loader_ = loader;
+
+  if (loader_) {
+    connect(loader_, SIGNAL(finished()), this, SIGNAL(loaded()));
+    loader_->start();
+  }
+}
+
+void Document::setVisibleRegion(const QRect &region)
+{
+  if (loader_)
+    loader_->setVisibleRegion(region);
+}
+
 Selection* Document::createSelection()
 {
   if (selection_)
@@ -115,18 +154,6 @@ void Document::clearFloatingSelection()
   }
 }
 
-void Document::acquire(StitchItem *item)
-{
-  colors_.acquire(item);
-  stitches_.insert(item);
-}
-
-void Document::release(StitchItem *item)
-{
-  colors_.release(item);
-  stitches_.remove(item);
-}
-
 void Document::setName(const QString &name)
 {
   name_ = name;
@@ -155,8 +182,10 @@ void Document::setSize(const QSize &size)
 void Document::setChanged(bool b)
 {
   changed_ = b;
-  if (changed_)
+  if (changed_) {
+    ++revision_;
     emit documentChanged();
+  }
   else
     emit documentSaved();
 }
@@ -166,6 +195,12 @@ void Document::documentChanged_()
   setChanged(true);
 }
 
+void Document::undoIndexChanged_()
+{
+  /* undo and redo do not go through Editor::edit() */
+  ++revision_;
+}
+
 void Document::resetGrid()
 {
   if (grid_)
@@ -16,6 +16,7 @@ class Selection;
 class SelectionGroup;
 class SparseMap;
 class StitchItem;
+class TileLoader;
 
 class Document : public QGraphicsScene
 {
@@ -33,6 +34,10 @@ class Document : public QGraphicsScene
   const QString& author() const { return author_; }
   bool changed() const { return changed_; }
 
+  /* goes up with every edit, undo and redo; the contents did not change
+   * while it stays the same */
+  int revision() const { return revision_; }
+
   Editor* editor() { return editor_; }
   ColorUsageTracker* colorTracker() { return &colors_; }
   SparseMap* map() { return map_; }
@@ -45,14 +50,22 @@ class Document : public QGraphicsScene
   SelectionGroup* createFloatingSelection(const QByteArray &data);
   SelectionGroup* floatingSelection() { return floatingSelection_; }
   void clearFloatingSelection();
-  
-  void acquire(StitchItem *item);
-  void release(StitchItem *item);
 
+  /* Documents opened from tiled files fill in over time. Anything about
+   * to read or edit a region calls ensureLoaded() first; a null region
+   * stands for the whole document. */
+  void ensureLoaded(const QRect &region = QRect());
+  bool isLoaded() const;
+  void setTileLoader(TileLoader *loader);
+
+  /* region on screen, in cells, which is loaded first */
+  void setVisibleRegion(const QRect &region);
+  
  signals:
   void documentChanged();
   void documentSaved();
   void madeSelection(const QRect &rect);
+  void loaded();
 
  public slots:
   void setName(const QString &name);
@@ -63,6 +76,7 @@ class Document : public QGraphicsScene
 
  private slots:
   void documentChanged_();
+  void undoIndexChanged_();
 
  private:
   void resetGrid();
@@ -75,14 +89,15 @@ class Document : public QGraphicsScene
   QSize size_;
 
   bool changed_;
+  int revision_;
 
   Selection *selection_;
   SelectionGroup *floatingSelection_;
   Editor *editor_;
   SparseMap *map_;
+  TileLoader *loader_;
   QGraphicsItemGroup *grid_;
   ColorUsageTracker colors_;
-  QSet<StitchItem *> stitches_;
 };
 
 #endif
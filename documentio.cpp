@@ -1,16 +1,23 @@
+#include <QBuffer>
+#include <QDataStream>
 #include <QFile>
+#include <QFuture>
+#include <QHash>
+#include <QList>
 #include <QMap>
-#include <QTextStream>
-
-#include <qjson/parser.h>
-#include <qjson/serializer.h>
+#include <QPair>
+#include <QThreadPool>
+#include <QtConcurrentRun>
 
 #include "cell.h"
 #include "colormanager.h"
 #include "document.h"
 #include "globalstate.h"
-#include "kdtree.h"
+#include "imageimporter.h"
+#include "jsonstream.h"
 #include "sparsemap.h"
+#include "tileloader.h"
+#include "utils.h"
 
 #include "documentio.h"
 
@@ -27,196 +34,749 @@ DocumentIo::~DocumentIo()
 
 }
 
-QVariant DocumentIo::save(QString &error)
-{
-  VariantMap output;
+/* DocumentIoV1 */
+
+/* bytes of stitch text parsed per task */
+#define STITCH_CHUNK_SIZE (256 * 1024)
 
-  output["version"] = version();
-  output["data"] = serialize(error);
+DocumentIoV1::DocumentIoV1(Document *doc)
+    : DocumentIo(doc)
+{
 
-  if (output["data"].isNull())
-    return QVariant();
+}
 
-  return QVariant(output);
+DocumentIoV1::~DocumentIoV1()
+{
+  
 }
 
-bool DocumentIo::load(const QVariant &data, QString &error)
+bool DocumentIoV1::read(QIODevice *device, QString &error)
 {
-  if (data.type() != QVariant::Map) {
-    error = QObject::tr("Invalid JSON format.");
+  JsonReader reader(device);
+  int version = -1;
+  bool hasData = false;
+
+  if (reader.next() != JsonToken_BeginObject) {
+    error = QObject::tr("Invalid document format.");
     return false;
   }
 
-  return deserialize(data.toMap(), error);
-}
+  /* the version may come after the data, so it is checked last */
+  for (JsonToken token = reader.next();
+       token != JsonToken_EndObject;
+       token = reader.next()) {
+    if (token != JsonToken_Key) {
+      error = QObject::tr("This file is corrupted.");
+      return false;
+    }
 
-/* DocumentIoV1 */
+    QString key = reader.string();
+    token = reader.next();
+
+    if (key == "version" && token == JsonToken_Number) {
+      version = reader.integer();
+    } else if (key == "data" && token == JsonToken_BeginObject) {
+      if (!readData(reader, error))
+        return false;
+      hasData = true;
+    } else if (!reader.skip(token)) {
+      error = QObject::tr("This file is corrupted.");
+      return false;
+    }
+  }
 
-DocumentIoV1::DocumentIoV1(Document *doc)
-    : DocumentIo(doc)
+  if (version != this->version() || !hasData) {
+    error = QObject::tr("Invalid document format.");
+    return false;
+  }
+
+  return true;
+}
+
+bool DocumentIoV1::write(QIODevice *device, QString &error) const
 {
+  document_->ensureLoaded();
+
+  JsonWriter writer(device);
+
+  const QSize &dim = document_->size();
+
+  writer.beginObject();
+  writer.key("version");
+  writer.value(version());
+  writer.key("data");
+  writer.beginObject();
+  writer.key("rows");
+  writer.value(dim.height());
+  writer.key("columns");
+  writer.value(dim.width());
+  writer.key("title");
+  writer.value(document_->title());
+  writer.key("author");
+  writer.value(document_->author());
+  writer.key("colors");
+  writeColors(writer);
+  writer.key("stitches");
+  writeStitches(writer);
+  writer.endObject();
+  writer.endObject();
+
+  if (!writer.flush()) {
+    error = QObject::tr("Could not write the document.");
+    return false;
+  }
 
+  return true;
 }
 
-DocumentIoV1::~DocumentIoV1()
+void DocumentIoV1::writeColors(JsonWriter &writer) const
 {
-  
+  writer.beginArray();
+
+  foreach (const Color *c, document_->colorTracker()->colorList())
+    writeColor(writer, c);
+
+  writer.endArray();
 }
 
-QVariant DocumentIoV1::serialize(QString &error) const
+void DocumentIoV1::writeStitches(JsonWriter &writer) const
 {
-  VariantMap root;
+  writer.beginArray();
 
-  const QSize &dim = document_->size();
-  root["rows"] = dim.height();
-  root["columns"] = dim.width();
-  root["title"] = document_->title();
-  root["author"] = document_->author();
-  root["colors"] = serializeColors(error);
-  root["stitches"] = serializeStitches(error);
+  const CellMap &cells = document_->map()->cells();
+
+  for (CellMap::ConstIterator it = cells.begin(); it != cells.end(); ++it) {
+    const QPoint &pos = it.key();
+    const Cell *cell = it.value();
+
+    if (!cell->featureMask())
+      continue;
+
+    writer.beginObject();
+    writer.key("x");
+    writer.value(pos.x());
+    writer.key("y");
+    writer.value(pos.y());
+
+    writer.key("features");
+    writer.beginArray();
+    for (int i = 0; i < CELL_COUNT; ++i) {
+      if (cell->contains(i))
+        writeFeature(writer, cell->color(i), i);
+    }
+    writer.endArray();
+
+    writer.endObject();
+  }
 
-  if (root["colors"].isNull() || root["stitches"].isNull())
-    return QVariant();
+  writer.endArray();
+}
+
+void DocumentIoV1::writeColor(JsonWriter &writer, const Color *c)
+{
+  writer.beginObject();
+  if (c->parent()) {
+    writer.key("category");
+    writer.value(c->parent()->id());
+  }
+  writer.key("id");
+  writer.value(c->id());
+  writer.key("name");
+  writer.value(c->name());
+  writer.key("color");
+  writer.value(c->color().name());
+  writer.endObject();
+}
 
-  return QVariant(root);
+void DocumentIoV1::writeFeature(JsonWriter &writer, const Color *c,
+                                int feature)
+{
+  writer.beginArray();
+  if (c && c->parent())
+    writer.value(c->parent()->id());
+  else
+    writer.null();
+  writer.value(c ? c->id() : QString());
+  writer.value(feature);
+  writer.endArray();
 }
 
-bool DocumentIoV1::deserialize(const VariantMap &data, QString &error)
+bool DocumentIoV1::readData(JsonReader &reader, QString &error)
 {
-  QSize size(data["columns"].toInt(), data["rows"].toInt());
+  QSize size;
+  QString title, author;
+  int count = 0;
+  bool hasStitches = false;
+
+  /* stitches read before the size is known wait here */
+  QList<DecodedTile *> pending;
+
+  for (JsonToken token = reader.next();
+       token != JsonToken_EndObject;
+       token = reader.next()) {
+    if (token != JsonToken_Key) {
+      qDeleteAll(pending);
+      error = QObject::tr("This file is corrupted.");
+      return false;
+    }
+
+    QString key = reader.string();
+    token = reader.next();
+
+    bool ok = true;
+    if (key == "rows" && token == JsonToken_Number) {
+      size.setHeight(reader.integer());
+    } else if (key == "columns" && token == JsonToken_Number) {
+      size.setWidth(reader.integer());
+    } else if (key == "title" && token == JsonToken_String) {
+      title = reader.string();
+    } else if (key == "author" && token == JsonToken_String) {
+      author = reader.string();
+    } else if (key == "stitches" && token == JsonToken_BeginArray) {
+      ok = readStitches(reader, pending, count);
+      hasStitches = true;
+    } else {
+      ok = reader.skip(token);
+    }
+
+    if (!ok) {
+      qDeleteAll(pending);
+      error = QObject::tr("This file is corrupted.");
+      return false;
+    }
+
+    /* the map only takes cells within the document, so it needs the size
+     * before any stitch goes in */
+    if (size.isValid() && !size.isEmpty())
+      document_->setSize(size);
+  }
 
-  if (size == QSize()) {
+  if (!size.isValid() || size.isEmpty()) {
+    qDeleteAll(pending);
     error = QObject::tr("Invalid document size.");
     return false;
   }
   document_->setSize(size);
 
-  document_->setTitle(data["title"].toString());
-  document_->setAuthor(data["author"].toString());
+  foreach (DecodedTile *tile, pending) {
+    TileLoader::insert(document_->map(), *tile);
+    delete tile;
+  }
+
+  document_->setTitle(title);
+  document_->setAuthor(author);
 
-  QVariant sv = data["stitches"];
-  if (sv.isNull() || sv.type() != QVariant::List) {
+  if (!hasStitches) {
     error = QObject::tr("No stitch data!");
     return false;
   }
 
-  VariantList sl = sv.toList();
-  if (!deserializeStitches(sl, error))
+  if (!count) {
+    error = QObject::tr("No stitch item!");
     return false;
+  }
 
   return true;
 }
 
-VariantList DocumentIoV1::serializeColors(QString &error) const
+bool DocumentIoV1::readStitches(JsonReader &reader,
+                                QList<DecodedTile *> &pending, int &count)
 {
-  Q_UNUSED(error);
+  const MetaColorManager *meta = GlobalState::self()->colorManager();
+  QList<QFuture<DecodedTile *> > chunks;
+
+  /* a couple of chunks per thread keep the pool busy; more would only
+   * hold the file in memory again */
+  int inFlight = 2 * qMax(1, QThreadPool::globalInstance()->maxThreadCount());
+
+  QByteArray text;
+  bool ok = true;
+
+  for (JsonToken token = reader.next(); ok; token = reader.next()) {
+    if (token == JsonToken_BeginObject) {
+      text.append(text.isEmpty() ? '[' : ',');
+      ok = reader.readRaw(token, text);
+    } else if (token != JsonToken_EndArray) {
+      ok = reader.skip(token);
+    }
+
+    if (!ok)
+      break;
+
+    if (!text.isEmpty() &&
+        (text.size() >= STITCH_CHUNK_SIZE || token == JsonToken_EndArray)) {
+      text.append(']');
+      chunks.append(QtConcurrent::run(&DocumentIoV1::readChunk, meta, text));
+      text.clear();
+    }
+
+    /* merge what is done while the rest is still being read, and wait
+     * for the oldest chunk when too many are queued */
+    while (ok && !chunks.isEmpty() &&
+           (chunks.first().isFinished() || chunks.size() >= inFlight)) {
+      DecodedTile *tile = chunks.takeFirst().result();
+      if (!tile) {
+        ok = false;
+        break;
+      }
+
+      insertStitches(tile, pending, count);
+    }
+
+    if (token == JsonToken_EndArray)
+      break;
+  }
+
+  /* chunks still in flight are waited for even after an error */
+  while (!chunks.isEmpty()) {
+    DecodedTile *tile = chunks.takeFirst().result();
+    if (!tile) {
+      ok = false;
+    } else {
+      if (ok)
+        insertStitches(tile, pending, count);
+      else
+        delete tile;
+    }
+  }
 
-  VariantList list;
+  return ok;
+}
 
-  const ColorUsageTracker *colorTracker = document_->colorTracker();
-  const QVector<const Color *> colors = colorTracker->colorList();
+void DocumentIoV1::insertStitches(DecodedTile *tile,
+                                  QList<DecodedTile *> &pending, int &count)
+{
+  count += tile->positions.size();
 
-  foreach (const Color *c, colors) {
-    VariantMap item;
-    if (c->parent())
-      item["category"] = c->parent()->id();
-    item["id"] = c->id();
-    item["name"] = c->name();
-    item["color"] = c->color().name();
-    list.append(QVariant(item));
+  if (document_->size().isEmpty()) {
+    pending.append(tile);
+    return;
   }
 
-  return list;
+  TileLoader::insert(document_->map(), *tile);
+  delete tile;
 }
 
-VariantList DocumentIoV1::serializeStitches(QString &error) const
+DecodedTile* DocumentIoV1::readChunk(const MetaColorManager *meta,
+                                     const QByteArray &text)
 {
-  Q_UNUSED(error);
+  QBuffer buffer;
+  buffer.setData(text);
+  buffer.open(QIODevice::ReadOnly);
 
-  VariantList list;
+  JsonReader reader(&buffer);
+  if (reader.next() != JsonToken_BeginArray)
+    return NULL;
 
-  const CellMap &cells = document_->map()->cells();
+  ColorResolver resolver(meta);
+  DecodedTile *tile = new DecodedTile;
 
-  for (CellMap::ConstIterator it = cells.begin(); it != cells.end(); ++it) {
-    const QPoint &pos = it.key();
-    const Cell *cell = it.value();
+  for (JsonToken token = reader.next();
+       token != JsonToken_EndArray;
+       token = reader.next()) {
+    bool ok = token == JsonToken_BeginObject ?
+        readStitch(reader, resolver, *tile) : reader.skip(token);
+    if (!ok) {
+      delete tile;
+      return NULL;
+    }
+  }
 
-    VariantMap map;
-    map["x"] = pos.x();
-    map["y"] = pos.y();
-    
-    VariantList features;
-    for (int i = 0; i < CELL_COUNT; ++i) {
-      if (cell->contains(i)) {
-        VariantList cellItem;
-        const Color *c = cell->color(i);
-        if (c->parent())
-          cellItem << c->parent()->id();
-        else
-          cellItem << QVariant();
-        cellItem << c->id();
-        cellItem << i;
-        features.append(QVariant(cellItem));
+  return tile;
+}
+
+bool DocumentIoV1::readStitch(JsonReader &reader, ColorResolver &resolver,
+                              DecodedTile &tile)
+{
+  bool hasX = false, hasY = false;
+  int x = 0, y = 0;
+
+  /* features may come before the position, so they wait here */
+  const Color *colors[CELL_COUNT];
+  int mask = 0;
+
+  for (JsonToken token = reader.next();
+       token != JsonToken_EndObject;
+       token = reader.next()) {
+    if (token != JsonToken_Key)
+      return false;
+
+    QString key = reader.string();
+    token = reader.next();
+
+    if (key == "x" && token == JsonToken_Number) {
+      x = reader.integer();
+      hasX = true;
+    } else if (key == "y" && token == JsonToken_Number) {
+      y = reader.integer();
+      hasY = true;
+    } else if (key == "features" && token == JsonToken_BeginArray) {
+      /* every feature is a [category, id, feature] triple */
+      for (token = reader.next();
+           token != JsonToken_EndArray;
+           token = reader.next()) {
+        if (token != JsonToken_BeginArray)
+          return false;
+
+        QString fields[2];
+        int feature = -1;
+        int field = 0;
+        for (token = reader.next();
+             token != JsonToken_EndArray;
+             token = reader.next(), ++field) {
+          if (token == JsonToken_String && field < 2)
+            fields[field] = reader.string();
+          else if (token == JsonToken_Number && field == 2)
+            feature = reader.integer();
+          else if (!reader.skip(token))
+            return false;
+        }
+
+        if (feature >= 0 && feature < CELL_COUNT) {
+          colors[feature] = resolver.resolve(fields[0], fields[1]);
+          mask |= 1 << feature;
+        }
       }
+    } else if (!reader.skip(token)) {
+      return false;
     }
+  }
 
-    if (features.length() == 0)
-      continue;
+  if (!hasX || !hasY || !mask)
+    return true;
+
+  tile.positions.append(QPoint(x, y));
+  tile.masks.append(mask);
+  for (int i = 0; i < CELL_COUNT; ++i) {
+    if (mask & (1 << i))
+      tile.colors.append(colors[i]);
+  }
+
+  return true;
+}
+
+/* DocumentIoV2 */
+
+#define DOCUMENT_FLAG_COMPRESSED 0x1
+/* always set; files without a tile index are not read */
+#define DOCUMENT_FLAG_TILE_INDEX 0x2
+
+/* sanity limits for reading */
+#define DOCUMENT_MAX_PALETTE (1 << 20)
+#define DOCUMENT_MAX_TILE_SIZE 4096
+#define DOCUMENT_MAX_TILES (1 << 20)
+
+static int tileOf(int v)
+{
+  if (v >= 0)
+    return v / DOCUMENT_TILE_SIZE;
+
+  return -((-v + DOCUMENT_TILE_SIZE - 1) / DOCUMENT_TILE_SIZE);
+}
+
+struct TileData
+{
+  TileData() : cells(0), last(-1) { }
+
+  QByteArray bytes;
+  int cells;
+  int last;
+};
+
+/* Collects cells into tiles and writes a V2 document. Cells have to be
+ * added in row major order, which keeps the gaps within a tile positive
+ * and small. */
+class TileWriter
+{
+ public:
+  void add(const QPoint &pos, int mask, const Color * const *colors);
+  bool write(QIODevice *device, const QSize &size, const QString &title,
+             const QString &author, bool compress, QString &error) const;
+
+ private:
+  int paletteIndex(const Color *color);
+
+ private:
+  QVector<const Color *> palette_;
+  QHash<const Color *, int> paletteIndex_;
 
-    map["features"] = features;
+  /* keyed by row, then column */
+  QMap<QPair<int, int>, TileData> tiles_;
+};
 
-    list.append(QVariant(map));
+void TileWriter::add(const QPoint &pos, int mask, const Color * const *colors)
+{
+  int tx = tileOf(pos.x());
+  int ty = tileOf(pos.y());
+  TileData &tile = tiles_[qMakePair(ty, tx)];
+
+  int index = (pos.y() - ty * DOCUMENT_TILE_SIZE) * DOCUMENT_TILE_SIZE +
+      pos.x() - tx * DOCUMENT_TILE_SIZE;
+  Q_ASSERT(index > tile.last);
+
+  Utils::putVarint(tile.bytes, index - tile.last - 1);
+  Utils::putVarint(tile.bytes, mask);
+  for (int i = 0; i < CELL_COUNT; ++i) {
+    if (mask & (1 << i))
+      Utils::putVarint(tile.bytes, paletteIndex(colors[i]));
   }
 
-  return list;
+  tile.last = index;
+  ++tile.cells;
 }
 
-bool DocumentIoV1::deserializeStitches(const VariantList &list, QString &error)
+int TileWriter::paletteIndex(const Color *color)
 {
-  SparseMap *map = document_->map();
-  MetaColorManager *cm = GlobalState::self()->colorManager();
+  QHash<const Color *, int>::ConstIterator it = paletteIndex_.find(color);
+  if (it != paletteIndex_.end())
+    return it.value();
 
-  int cnt = 0;
-  foreach (const QVariant &v, list) {
-    if (v.type() != QVariant::Map)
-      continue;
+  int index = palette_.size();
+  palette_.append(color);
+  paletteIndex_.insert(color, index);
 
-    VariantMap m = v.toMap();
-    int x = m["x"].toInt();
-    int y = m["y"].toInt();
-    
-    if (x == 0 || y == 0)
-      continue;
+  return index;
+}
 
-    VariantList features = m["features"].toList();
-    if (features.length() == 0)
-      continue;
+bool TileWriter::write(QIODevice *device, const QSize &size,
+                       const QString &title, const QString &author,
+                       bool compress, QString &error) const
+{
+  if (device->write(DOCUMENT_MAGIC, DOCUMENT_MAGIC_SIZE) !=
+      DOCUMENT_MAGIC_SIZE) {
+    error = QObject::tr("Could not write the document.");
+    return false;
+  }
+
+  QDataStream stream(device);
+  stream.setVersion(QDataStream::Qt_4_6);
+
+  quint32 flags = DOCUMENT_FLAG_TILE_INDEX;
+  if (compress)
+    flags |= DOCUMENT_FLAG_COMPRESSED;
+
+  stream << (quint32) 2 << flags;
+  stream << (qint32) size.width() << (qint32) size.height();
+  stream << title << author;
+
+  /* unresolved colors are kept as an empty pair */
+  stream << (quint32) palette_.size();
+  foreach (const Color *c, palette_) {
+    QString category;
+    QString id;
+    if (c) {
+      if (c->parent())
+        category = c->parent()->id();
+      id = c->id();
+    }
+    stream << category << id;
+  }
 
-    Cell *c = map->cellAt(QPoint(x, y));
-    foreach (const QVariant &f, features) {
-      const VariantList &fi = f.toList();
+  /* the index lists where every tile's payload starts, counted from the
+   * end of the index, so a reader can pick tiles in any order */
+  QList<QByteArray> payloads;
+  quint32 offset = 0;
+
+  stream << (quint32) DOCUMENT_TILE_SIZE << (quint32) tiles_.size();
+  for (QMap<QPair<int, int>, TileData>::ConstIterator it = tiles_.begin();
+       it != tiles_.end();
+       ++it) {
+    const TileData &tile = it.value();
+    QByteArray payload = compress ? qCompress(tile.bytes) : tile.bytes;
+
+    stream << (qint32) it.key().second << (qint32) it.key().first;
+    stream << (quint32) tile.cells << (quint32) tile.bytes.size();
+    stream << offset << (quint32) payload.size();
+
+    offset += payload.size();
+    payloads.append(payload);
+  }
 
-      const Color *color = cm->get(fi[0].toString(), fi[1].toString());
-      c->addFeature(fi[2].toInt(), color);
+  foreach (const QByteArray &payload, payloads) {
+    if (device->write(payload) != payload.size()) {
+      error = QObject::tr("Could not write the document.");
+      return false;
     }
-    c->createGraphicsItems();
+  }
 
-    ++cnt;
+  if (stream.status() != QDataStream::Ok) {
+    error = QObject::tr("Could not write the document.");
+    return false;
   }
 
-  if (!cnt) {
-    error = QObject::tr("No stitch item!");
+  return true;
+}
+
+DocumentIoV2::DocumentIoV2(Document *doc, bool compress)
+    : DocumentIo(doc), compress_(compress)
+{
+
+}
+
+DocumentIoV2::~DocumentIoV2()
+{
+
+}
+
+bool DocumentIoV2::read(QIODevice *device, QString &error)
+{
+  error = QObject::tr("This file is corrupted.");
+
+  if (device->read(DOCUMENT_MAGIC_SIZE) != DOCUMENT_MAGIC)
+    return false;
+
+  QDataStream stream(device);
+  stream.setVersion(QDataStream::Qt_4_6);
+
+  quint32 version, flags;
+  qint32 width, height;
+  QString title, author;
+  stream >> version >> flags >> width >> height >> title >> author;
+  if (stream.status() != QDataStream::Ok || width <= 0 || height <= 0)
+    return false;
+
+  if ((int) version != this->version()) {
+    error = QObject::tr("Unsupport version %1").arg(version);
+    return false;
+  }
+
+  if (!(flags & DOCUMENT_FLAG_TILE_INDEX))
     return false;
+
+  document_->setSize(QSize(width, height));
+  document_->setTitle(title);
+  document_->setAuthor(author);
+
+  quint32 paletteSize;
+  stream >> paletteSize;
+  if (stream.status() != QDataStream::Ok ||
+      paletteSize > DOCUMENT_MAX_PALETTE)
+    return false;
+
+  MetaColorManager *cm = GlobalState::self()->colorManager();
+  QVector<const Color *> palette(paletteSize);
+  for (quint32 i = 0; i < paletteSize; ++i) {
+    QString category, id;
+    stream >> category >> id;
+    palette[i] = cm->get(category, id);
+  }
+
+  quint32 tileSize, tileCount;
+  stream >> tileSize >> tileCount;
+  if (stream.status() != QDataStream::Ok ||
+      tileSize == 0 || tileSize > DOCUMENT_MAX_TILE_SIZE ||
+      tileCount > DOCUMENT_MAX_TILES)
+    return false;
+
+  QVector<TileRecord> tiles(tileCount);
+  for (quint32 t = 0; t < tileCount; ++t) {
+    TileRecord &r = tiles[t];
+    stream >> r.x >> r.y >> r.cellCount >> r.rawSize >> r.offset >> r.size;
+  }
+  if (stream.status() != QDataStream::Ok)
+    return false;
+
+  QByteArray data = device->readAll();
+  foreach (const TileRecord &r, tiles) {
+    if ((qint64) r.offset + r.size > data.size())
+      return false;
+
+    /* a tile outside the document would decode to cells with nowhere
+     * to go */
+    if (r.x < 0 || r.y < 0 ||
+        (qint64) r.x * tileSize >= width || (qint64) r.y * tileSize >= height)
+      return false;
   }
 
+  /* the document is usable right away and fills in as tiles decode */
+  document_->setTileLoader(
+      new TileLoader(document_, palette, tiles, data, tileSize,
+                     flags & DOCUMENT_FLAG_COMPRESSED));
+
+  error.clear();
   return true;
 }
 
+bool DocumentIoV2::write(QIODevice *device, QString &error) const
+{
+  document_->ensureLoaded();
+
+  return writeSnapshot(device, snapshot(document_), compress_, error);
+}
+
+DocumentSnapshot DocumentIoV2::snapshot(Document *doc)
+{
+  DocumentSnapshot s;
+  s.size = doc->size();
+  s.title = doc->title();
+  s.author = doc->author();
+
+  const CellMap &cells = doc->map()->cells();
+  s.cells.positions.reserve(cells.size());
+  s.cells.masks.reserve(cells.size());
+  s.cells.colors.reserve(cells.size());
+
+  for (CellMap::ConstIterator it = cells.begin(); it != cells.end(); ++it) {
+    const Cell *cell = it.value();
+    int mask = cell->featureMask();
+    if (!mask)
+      continue;
+
+    s.cells.positions.append(it.key());
+    s.cells.masks.append(mask);
+    for (int i = 0; i < CELL_COUNT; ++i) {
+      if (mask & (1 << i))
+        s.cells.colors.append(cell->color(i));
+    }
+  }
+
+  return s;
+}
+
+bool DocumentIoV2::writeSnapshot(QIODevice *device,
+                                 const DocumentSnapshot &snapshot,
+                                 bool compress, QString &error)
+{
+  TileWriter writer;
+  const Color *colors[CELL_COUNT];
+
+  const DecodedTile &cells = snapshot.cells;
+  int k = 0;
+  for (int i = 0; i < cells.positions.size(); ++i) {
+    int mask = cells.masks[i];
+    for (int f = 0; f < CELL_COUNT; ++f)
+      colors[f] = mask & (1 << f) ? cells.colors[k++] : NULL;
+    writer.add(cells.positions[i], mask, colors);
+  }
+
+  return writer.write(device, snapshot.size, snapshot.title, snapshot.author,
+                      compress, error);
+}
+
+bool DocumentIoV2::writeChart(QIODevice *device, const QSize &size,
+                              const QString &title, const QString &author,
+                              const QVector<const Color *> &cells,
+                              QString &error)
+{
+  TileWriter writer;
+  const Color *colors[CELL_COUNT];
+
+  for (int y = 0; y < size.height(); ++y) {
+    for (int x = 0; x < size.width(); ++x) {
+      colors[CELL_FULL] = cells[y * size.width() + x];
+      if (colors[CELL_FULL])
+        writer.add(QPoint(x, y), MASK_CELL_FULL, colors);
+    }
+  }
+
+  return writer.write(device, size, title, author, true, error);
+}
+
 /* DocumentFactory */
 
 DocumentIo* DocumentFactory::defaultSerializer(Document *doc)
 {
-  return new DocumentIoV1(doc);
+  return new DocumentIoV2(doc);
 }
 
 Document* DocumentFactory::load(const QString &path, QString &error)
@@ -227,124 +787,130 @@ Document* DocumentFactory::load(const QString &path, QString &error)
     return NULL;
   }
 
-  QTextStream stream(&file);
-  QString jsonText = stream.readAll();
-  file.close();
-
-  QJson::Parser parser;
-  bool ok;
-  QVariant body = parser.parse(jsonText.toUtf8(), &ok);
-
-  if (!ok) {
-    error = QObject::tr("This file is corrupted.");
-    return NULL;
-  }
-
-  VariantMap map = body.toMap();
-  if (map.isEmpty()) {
-    error = QObject::tr("Invalid document format.");
-    return NULL;
-  }
-
   Document *doc = new Document();
 
   DocumentIo *io = NULL;
-  int version = map["version"].toInt();
-  switch (map["version"].toInt()) {
+  int version = detectVersion(&file);
+  switch (version) {
     case 1:
       io = new DocumentIoV1(doc);
       break;
+    case 2:
+      io = new DocumentIoV2(doc);
+      break;
     default:
       error = QObject::tr("Unsupport version %1").arg(version);
       delete doc;
       return NULL;
   }
 
-  const QVariant &subdata = map["data"];
-  if (!io->load(subdata, error)) {
+  if (!io->read(&file, error)) {
     delete doc;
     doc = NULL;
   }
 
   delete io;
+  file.close();
 
   return doc;
 }
 
 Document* DocumentFactory::load(const QImage &image, ColorManager *manager,
-				int width, const QColor *transparentColor)
+				int width, const QColor *transparentColor,
+				DitherMode dither, int maxColors)
 {
-  if (image.isNull())
+  ImageImporter importer(manager, width, transparentColor);
+  importer.setDitherMode(dither);
+  importer.setMaxColors(maxColors);
+
+  if (!importer.run(image))
     return NULL;
 
-  int height = image.height() / (image.width() / (float) width);
-  QImage scaled = image.scaled(width + 1, height + 1, Qt::KeepAspectRatio);
+  return importer.createDocument();
+}
 
-  Document *doc = new Document(QSize(width, height));
-  SparseMap *map = doc->map();
-  Color *transparent = NULL;
-  if (transparentColor)
-    transparent = new Color("Transparent color", "transparent", *transparentColor);
+/* Documents are written next to their path first and only replace the
+ * file once complete, so a failed save leaves the old file alone. */
+static bool openTemp(QFile &file, const QString &path, QString &error)
+{
+  file.setFileName(path + ".tmp");
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+    error = QObject::tr("Coule not open file %1.").arg(file.fileName());
+    return false;
+  }
 
-  KdTree kdtree(manager, transparent);
-  
-  for (int x = 0; x < width; ++x) {
-    for (int y = 0; y < height; ++y) {
-      QRgb pix = scaled.pixel(x, y);
+  return true;
+}
 
-      QColor c;
-      if (qAlpha(pix) < 64)
-	continue;
-      else
-	c = QColor(pix);
+static bool commitTemp(QFile &file, const QString &path, bool ok,
+                       QString &error)
+{
+  file.close();
+  if (ok && file.error() != QFile::NoError) {
+    error = QObject::tr("Could not write the document.");
+    ok = false;
+  }
 
-      const Color *stitch = kdtree.nearest(c);
-      if (stitch == transparent || !stitch)
-	continue;
+  if (!ok) {
+    file.remove();
+    return false;
+  }
 
-      Cell *cell = map->cellAt(QPoint(x, y));
-      cell->addFullStitch(stitch);
-      cell->createGraphicsItems();
-    }
+  if (!Utils::replaceFile(file.fileName(), path)) {
+    file.remove();
+    error = QObject::tr("Could not write the document.");
+    return false;
   }
-  
-  if (transparent)
-    delete transparent;
 
-  return doc;
+  return true;
 }
 
 bool DocumentFactory::save(Document *doc, const QString &path, QString &error)
 {
-  QFile file(path);
-  if (!file.open(QIODevice::WriteOnly)) {
-    error = QObject::tr("Coule not open file %1.").arg(path);
+  QFile file;
+  if (!openTemp(file, path, error))
     return false;
-  }
 
   DocumentIo *io = defaultSerializer(doc);
-  QVariant out = io->save(error);
-  if (out.isNull()) {
-    delete io;
+  bool ok = io->write(&file, error);
+  delete io;
+
+  return commitTemp(file, path, ok, error);
+}
+
+bool DocumentFactory::save(const ImageImporter &importer, const QString &title,
+                           const QString &path, QString &error)
+{
+  QFile file;
+  if (!openTemp(file, path, error))
     return false;
-  }
 
-  QJson::Serializer sr;
-  //sr.setIndentMode(QJson::IndentMedium);
-  QByteArray output = sr.serialize(out);
+  bool ok = DocumentIoV2::writeChart(&file, importer.size(), title, QString(),
+                                     importer.cells(), error);
 
-  if (output.isNull()) {
-    delete io;
-    error = QObject::tr("Serialization error.");
-    file.close();
+  return commitTemp(file, path, ok, error);
+}
+
+bool DocumentFactory::save(const DocumentSnapshot &snapshot,
+                           const QString &path, QString &error)
+{
+  QFile file;
+  if (!openTemp(file, path, error))
     return false;
-  }
 
-  QTextStream outStream(&file);
-  outStream << output;
-  file.close();
-  
-  delete io;
+  bool ok = DocumentIoV2::writeSnapshot(&file, snapshot, true, error);
 
-  return true;
+  return commitTemp(file, path, ok, error);
+}
+
+int DocumentFactory::detectVersion(QIODevice *device)
+{
+  QByteArray head = device->peek(DOCUMENT_MAGIC_SIZE + 4);
+  if (head.size() < DOCUMENT_MAGIC_SIZE + 4 ||
+      !head.startsWith(DOCUMENT_MAGIC))
+    return 1;
+
+  const uchar *v =
+      reinterpret_cast<const uchar *>(head.constData()) + DOCUMENT_MAGIC_SIZE;
+  return (v[0] << 24) | (v[1] << 16) | (v[2] << 8) | v[3];
 }
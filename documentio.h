@@ -1,12 +1,27 @@
 #ifndef _DOCUMENTIO_H_
 #define _DOCUMENTIO_H_
 
-#include <QVariant>
+#include <QByteArray>
+#include <QList>
+#include <QSize>
+#include <QString>
+#include <QVector>
 
+#include "imageimporter.h"
+#include "tileloader.h"
+
+class QIODevice;
+
+class Color;
+class ColorResolver;
 class Document;
+class JsonReader;
+class JsonWriter;
+class MetaColorManager;
 
-typedef QMap<QString, QVariant> VariantMap;
-typedef QList<QVariant> VariantList;
+/* first bytes of a binary document, followed by its version */
+#define DOCUMENT_MAGIC "STCY"
+#define DOCUMENT_MAGIC_SIZE 4
 
 class DocumentIo
 {
@@ -14,18 +29,21 @@ class DocumentIo
   DocumentIo(Document *doc);
   virtual ~DocumentIo();
 
-  QVariant save(QString &error);
-  bool load(const QVariant &data, QString &error);
-
   virtual int version() const = 0;
 
-  virtual QVariant serialize(QString &error) const = 0;
-  virtual bool deserialize(const VariantMap &data, QString &error) = 0;
+  virtual bool read(QIODevice *device, QString &error) = 0;
+  virtual bool write(QIODevice *device, QString &error) const = 0;
 
  protected:
   Document *document_;
 };
 
+/* The original JSON format. Documents are read and written as a stream
+ * of tokens going straight between the device and the document map.
+ *
+ * Stitches are only bracket-matched while reading the file; their text
+ * is cut into chunks that are parsed and resolved on the thread pool,
+ * then merged into the map in file order. */
 class DocumentIoV1 : public DocumentIo
 {
  public:
@@ -34,14 +52,82 @@ class DocumentIoV1 : public DocumentIo
 
   int version() const { return 1; }
 
-  QVariant serialize(QString &error) const;
-  bool deserialize(const VariantMap &data, QString &error);
+  bool read(QIODevice *device, QString &error);
+  bool write(QIODevice *device, QString &error) const;
 
  private:
-  VariantList serializeColors(QString &error) const;
-  VariantList serializeStitches(QString &error) const;
+  static void writeColor(JsonWriter &writer, const Color *c);
+  static void writeFeature(JsonWriter &writer, const Color *c, int feature);
 
-  bool deserializeStitches(const VariantList &list, QString &error);
+  void writeColors(JsonWriter &writer) const;
+  void writeStitches(JsonWriter &writer) const;
+
+  bool readData(JsonReader &reader, QString &error);
+  bool readStitches(JsonReader &reader, QList<DecodedTile *> &pending,
+                    int &count);
+  void insertStitches(DecodedTile *tile, QList<DecodedTile *> &pending,
+                      int &count);
+
+  /* parses a JSON array of stitches, NULL if it is corrupted */
+  static DecodedTile* readChunk(const MetaColorManager *meta,
+                                const QByteArray &text);
+  static bool readStitch(JsonReader &reader, ColorResolver &resolver,
+                         DecodedTile &tile);
+};
+
+/* Copy of everything a document saves, taken on the GUI thread so that
+ * it can be written from any other. Cells are listed in map order and
+ * share their colors with the document. */
+struct DocumentSnapshot
+{
+  QSize size;
+  QString title;
+  QString author;
+  DecodedTile cells;
+};
+
+/* cells per side of a V2 tile */
+#define DOCUMENT_TILE_SIZE 64
+
+/* Binary document format.
+ *
+ * After the magic, the version and the document properties comes a table
+ * of the colors used, as category and id pairs, and then the stitches in
+ * tiles of DOCUMENT_TILE_SIZE square cells. A tile lists its cells in row
+ * major order, each as the varint gap to the previous cell, the varint
+ * feature mask and one varint palette index per feature, so charts with
+ * fewer than 128 colors take a byte per feature. Tiles are zlib
+ * compressed unless the document is written with compression off. Header
+ * fields are big endian through QDataStream.
+ *
+ * An index of all tiles precedes their payloads, so read() only reads
+ * the header and hands the payloads to a TileLoader: the document opens
+ * at once and its tiles decode in the background. */
+class DocumentIoV2 : public DocumentIo
+{
+ public:
+  DocumentIoV2(Document *doc, bool compress = true);
+  ~DocumentIoV2();
+
+  int version() const { return 2; }
+
+  bool read(QIODevice *device, QString &error);
+  bool write(QIODevice *device, QString &error) const;
+
+  /* the document has to be fully loaded */
+  static DocumentSnapshot snapshot(Document *doc);
+  static bool writeSnapshot(QIODevice *device,
+                            const DocumentSnapshot &snapshot, bool compress,
+                            QString &error);
+
+  /* full-stitch chart given as a row-major grid, NULL for empty cells */
+  static bool writeChart(QIODevice *device, const QSize &size,
+                         const QString &title, const QString &author,
+                         const QVector<const Color *> &cells,
+                         QString &error);
+
+ private:
+  bool compress_;
 };
 
 class DocumentFactory
@@ -50,8 +136,21 @@ class DocumentFactory
   static DocumentIo* defaultSerializer(Document *d);
   static Document* load(const QString &path, QString &error);
   static Document* load(const QImage &image, ColorManager *manager,
-			int width, const QColor *transparentColor);
+			int width, const QColor *transparentColor,
+			DitherMode dither = DitherMode_None,
+			int maxColors = 0);
   static bool save(Document *doc, const QString &path, QString &error);
+  static bool save(const ImageImporter &importer, const QString &title,
+                   const QString &path, QString &error);
+
+  /* writes next to the path and renames over it, so the path always
+   * holds a complete document; safe to call from any thread */
+  static bool save(const DocumentSnapshot &snapshot, const QString &path,
+                   QString &error);
+
+  /* version of the document on the device, without consuming it; JSON
+   * documents are all version 1 */
+  static int detectVersion(QIODevice *device);
 };
 
 #endif
@@ -18,7 +18,8 @@ enum ToolMode
   ToolMode_Quarter,
   ToolMode_Straight,
   ToolMode_Back,
-  ToolMode_Knot
+  ToolMode_Knot,
+  ToolMode_Fill
 };
 
 class Editor : public QUndoStack
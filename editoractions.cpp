@@ -1,5 +1,6 @@
 #include "canvas.h"
 #include "cell.h"
+#include "colormanager.h"
 #include "document.h"
 #include "selection.h"
 #include "selectiongroup.h"
@@ -78,6 +79,59 @@ void MergeAction::mergeWith_(const QList<Cell> &cells)
   }
 }
 
+RecolorAction::RecolorAction(Document *document,
+                             const QVector<QPoint> &positions,
+                             const QVector<const Color *> &from,
+                             const QVector<const Color *> &to)
+    : EditorAction(document), positions_(positions), from_(from), to_(to)
+{
+
+}
+
+RecolorAction::~RecolorAction()
+{
+
+}
+
+void RecolorAction::redo()
+{
+  apply(to_);
+}
+
+void RecolorAction::undo()
+{
+  apply(from_);
+}
+
+void RecolorAction::apply(const QVector<const Color *> &colors)
+{
+  SparseMap *map = document_->map();
+
+  bool uniform = colors.size() == 1;
+
+  for (int i = 0; i < positions_.size(); ++i) {
+    const QPoint &pos = positions_[i];
+    const Color *color = uniform ? colors[0] : colors[i];
+
+    if (!color) {
+      if (!map->contains(pos))
+        continue;
+
+      Cell *c = map->cellAt(pos);
+      c->remove(CELL_FULL);
+      if (c->isEmpty())
+        map->remove(pos);
+      continue;
+    }
+
+    Cell *c = map->cellAt(pos);
+    if (!c)
+      continue;
+    c->addFeature(CELL_FULL, color);
+    c->createGraphicsItems();
+  }
+}
+
 ActionDraw::ActionDraw(Document *document, SparseMap *map)
     : MergeAction(document, map)
 {
@@ -289,6 +343,138 @@ void ActionFloatCommit::undo()
   canvas_->paste(data_, false);
 }
 
+ActionCleanup::ActionCleanup(Document *document,
+                             const QVector<QPoint> &positions,
+                             const QVector<const Color *> &from,
+                             const QVector<const Color *> &to)
+    : RecolorAction(document, positions, from, to)
+{
+  setText(QObject::tr("Removing Confetti"));
+}
+
+ActionCleanup::~ActionCleanup()
+{
+
+}
+
+ActionFill::ActionFill(Document *document, const QVector<QPoint> &positions,
+                       const Color *from, const Color *to)
+    : RecolorAction(document, positions, QVector<const Color *>(1, from),
+                    QVector<const Color *>(1, to))
+{
+  setText(QObject::tr("Filling"));
+}
+
+ActionFill::~ActionFill()
+{
+
+}
+
+ActionReplaceColor::ActionReplaceColor(Document *document, const Color *from,
+                                       const Color *to)
+    : EditorAction(document)
+{
+  setText(QObject::tr("Replacing Color"));
+
+  mapping_.insert(from, to);
+  collect();
+}
+
+ActionReplaceColor::ActionReplaceColor(Document *document,
+                                       const ColorMapping &mapping)
+    : EditorAction(document), mapping_(mapping)
+{
+  setText(QObject::tr("Replacing Colors"));
+
+  collect();
+}
+
+ActionReplaceColor::~ActionReplaceColor()
+{
+
+}
+
+void ActionReplaceColor::redo()
+{
+  apply(true);
+}
+
+void ActionReplaceColor::undo()
+{
+  apply(false);
+}
+
+void ActionReplaceColor::collect()
+{
+  /* the tracker knows how many features use the colors, so the walk
+   * stops as soon as all of them are found */
+  const ColorUsageTracker *tracker = document_->colorTracker();
+  int remaining = 0;
+  for (ColorMapping::ConstIterator it = mapping_.begin();
+       it != mapping_.end();
+       ++it) {
+    if (it.key() != it.value())
+      remaining += tracker->uses(it.key());
+  }
+
+  const CellMap &cells = document_->map()->cells();
+
+  for (CellMap::ConstIterator it = cells.begin();
+       remaining > 0 && it != cells.end();
+       ++it) {
+    const Cell *cell = it.value();
+
+    for (int i = 0; i < CELL_COUNT; ++i) {
+      if (!cell->contains(i))
+        continue;
+
+      const Color *color = cell->color(i);
+      ColorMapping::ConstIterator mit = mapping_.find(color);
+      if (mit == mapping_.end() || mit.value() == color)
+        continue;
+
+      positions_.append(it.key());
+      features_.append(i);
+      colors_.append(color);
+      --remaining;
+    }
+  }
+}
+
+void ActionReplaceColor::apply(bool forward)
+{
+  SparseMap *map = document_->map();
+
+  for (int i = 0; i < positions_.size(); ++i) {
+    if (!map->contains(positions_[i]))
+      continue;
+
+    const Color *original = colors_[i];
+    const Color *replacement = mapping_.value(original);
+    const Color *from = forward ? original : replacement;
+    const Color *to = forward ? replacement : original;
+
+    Cell *c = map->cellAt(positions_[i]);
+    if (c->color(features_[i]) != from)
+      continue;
+
+    c->setColor(features_[i], to);
+    c->createGraphicsItems();
+  }
+}
+
+ActionConvertColors::ActionConvertColors(Document *document,
+                                         const ColorMapping &mapping)
+    : ActionReplaceColor(document, mapping)
+{
+  setText(QObject::tr("Converting Colors"));
+}
+
+ActionConvertColors::~ActionConvertColors()
+{
+
+}
+
 uint qHash(const QPoint &p)
 {
   return qHash((quint64)p.x() << 32 | (quint64)p.y());
@@ -2,10 +2,15 @@
 #define _EDITORACTIONS_H_
 
 #include <QList>
+#include <QPoint>
 #include <QUndoCommand>
+#include <QVector>
+
+#include "colormanager.h"
 
 class Canvas;
 class Cell;
+class Color;
 class SelectionGroup;
 class SparseMap;
 
@@ -44,6 +49,29 @@ class MergeAction : public EditorAction
   QList<Cell> drawn_;
 };
 
+/* Sets the full stitch color of many cells at once. Only positions and
+ * colors are kept, which is much smaller than a copy of every cell. A
+ * color vector with a single entry applies to all positions, and a NULL
+ * color stands for a cell without full stitch. */
+class RecolorAction : public EditorAction
+{
+ public:
+  RecolorAction(Document *document, const QVector<QPoint> &positions,
+                const QVector<const Color *> &from,
+                const QVector<const Color *> &to);
+  virtual ~RecolorAction();
+
+  void redo();
+  void undo();
+
+ protected:
+  void apply(const QVector<const Color *> &colors);
+
+  QVector<QPoint> positions_;
+  QVector<const Color *> from_;
+  QVector<const Color *> to_;
+};
+
 class ActionDraw : public MergeAction
 {
  public:
@@ -128,4 +156,53 @@ class ActionFloatCommit : public MergeAction
   QByteArray data_;
 };
 
+class ActionCleanup : public RecolorAction
+{
+ public:
+  ActionCleanup(Document *document, const QVector<QPoint> &positions,
+                const QVector<const Color *> &from,
+                const QVector<const Color *> &to);
+  ~ActionCleanup();
+};
+
+class ActionFill : public RecolorAction
+{
+ public:
+  ActionFill(Document *document, const QVector<QPoint> &positions,
+             const Color *from, const Color *to);
+  ~ActionFill();
+};
+
+/* Replaces one color with another in every stitch using it. Only the
+ * positions and features of those stitches are kept. */
+class ActionReplaceColor : public EditorAction
+{
+ public:
+  ActionReplaceColor(Document *document, const Color *from, const Color *to);
+  ActionReplaceColor(Document *document, const ColorMapping &mapping);
+  ~ActionReplaceColor();
+
+  bool isEmpty() const { return positions_.isEmpty(); }
+
+  void redo();
+  void undo();
+
+ private:
+  void collect();
+  void apply(bool forward);
+
+ private:
+  ColorMapping mapping_;
+  QVector<QPoint> positions_;
+  QVector<char> features_;
+  QVector<const Color *> colors_;
+};
+
+class ActionConvertColors : public ActionReplaceColor
+{
+ public:
+  ActionConvertColors(Document *document, const ColorMapping &mapping);
+  ~ActionConvertColors();
+};
+
 #endif
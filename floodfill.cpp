@@ -0,0 +1,124 @@
+#include "cell.h"
+#include "document.h"
+#include "sparsemap.h"
+
+#include "floodfill.h"
+
+FloodFill::FloodFill(Document *document, const QRect &bounds)
+    : document_(document),
+      bounds_(bounds & document->boundingRect()),
+      regionColor_(NULL)
+{
+
+}
+
+FloodFill::~FloodFill()
+{
+
+}
+
+int FloodFill::run(const QPoint &seed, bool diagonal)
+{
+  positions_.clear();
+
+  if (!bounds_.contains(seed))
+    return 0;
+
+  build(seed);
+
+  int width = bounds_.width();
+  char *mask = mask_.data();
+
+  QVector<QPoint> stack;
+  stack.append(seed - bounds_.topLeft());
+
+  while (!stack.isEmpty()) {
+    QPoint p = stack.last();
+    stack.pop_back();
+
+    char *row = mask + p.y() * width;
+    if (!row[p.x()])
+      continue;
+
+    int left = p.x();
+    while (left > 0 && row[left - 1])
+      --left;
+    int right = p.x();
+    while (right < width - 1 && row[right + 1])
+      ++right;
+
+    for (int x = left; x <= right; ++x) {
+      row[x] = 0;
+      positions_.append(bounds_.topLeft() + QPoint(x, p.y()));
+    }
+
+    if (diagonal) {
+      left = qMax(0, left - 1);
+      right = qMin(width - 1, right + 1);
+    }
+
+    if (p.y() > 0)
+      scanRow(p.y() - 1, left, right, stack);
+    if (p.y() < bounds_.height() - 1)
+      scanRow(p.y() + 1, left, right, stack);
+  }
+
+  return positions_.size();
+}
+
+void FloodFill::build(const QPoint &seed)
+{
+  const CellMap &cells = document_->map()->cells();
+
+  regionColor_ = NULL;
+  bool empty = true;
+
+  CellMap::ConstIterator it = cells.find(seed);
+  if (it != cells.end() && !it.value()->isEmpty()) {
+    /* partial stitches are never filled over */
+    if (it.value()->featureMask() != MASK_CELL_FULL) {
+      mask_.fill(0, bounds_.width() * bounds_.height());
+      return;
+    }
+
+    regionColor_ = it.value()->color(CELL_FULL);
+    empty = false;
+  }
+
+  /* an empty seed matches everything but the stored cells */
+  mask_.fill(empty ? 1 : 0, bounds_.width() * bounds_.height());
+  char *mask = mask_.data();
+
+  /* the map is ordered by row, so only the rows in bounds are visited */
+  for (it = cells.lowerBound(QPoint(0, bounds_.top())); it != cells.end(); ++it) {
+    const QPoint &pos = it.key();
+    if (pos.y() > bounds_.bottom())
+      break;
+    if (!bounds_.contains(pos))
+      continue;
+
+    const Cell *cell = it.value();
+    int i = (pos.y() - bounds_.y()) * bounds_.width() + pos.x() - bounds_.x();
+
+    if (empty)
+      mask[i] = cell->isEmpty();
+    else
+      mask[i] = cell->featureMask() == MASK_CELL_FULL &&
+          cell->color(CELL_FULL) == regionColor_;
+  }
+}
+
+void FloodFill::scanRow(int y, int left, int right, QVector<QPoint> &stack)
+{
+  const char *row = mask_.constData() + y * bounds_.width();
+  bool inRun = false;
+
+  for (int x = left; x <= right; ++x) {
+    if (!row[x]) {
+      inRun = false;
+    } else if (!inRun) {
+      stack.append(QPoint(x, y));
+      inRun = true;
+    }
+  }
+}
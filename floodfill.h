@@ -0,0 +1,44 @@
+#ifndef _FLOODFILL_H_
+#define _FLOODFILL_H_
+
+#include <QPoint>
+#include <QRect>
+#include <QVector>
+
+class Color;
+class Document;
+
+/* Scanline flood fill over full stitches.
+ *
+ * The region is every cell connected to the seed that holds the same full
+ * stitch color as the seed, or that is empty if the seed is. Cells with
+ * partial stitches stop the fill. A byte mask of the bounds is built from
+ * the cell map once, then filled span by span: each popped seed is
+ * extended left and right, and the rows above and below are scanned for
+ * the runs it touches, which keeps the stack at one entry per run. */
+class FloodFill
+{
+ public:
+  FloodFill(Document *document, const QRect &bounds);
+  ~FloodFill();
+
+  /* returns the number of cells in the region of seed */
+  int run(const QPoint &seed, bool diagonal);
+
+  /* full stitch color of the region, NULL if it is empty cells */
+  const Color* regionColor() const { return regionColor_; }
+  const QVector<QPoint>& positions() const { return positions_; }
+
+ private:
+  void build(const QPoint &seed);
+  void scanRow(int y, int left, int right, QVector<QPoint> &stack);
+
+ private:
+  Document *document_;
+  QRect bounds_;
+  QVector<char> mask_;
+  const Color *regionColor_;
+  QVector<QPoint> positions_;
+};
+
+#endif
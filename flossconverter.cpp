@@ -0,0 +1,305 @@
+#include <cmath>
+#include <cstring>
+
+#include <QCryptographicHash>
+#include <QDesktopServices>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+
+#include "color.h"
+#include "colormanager.h"
+#include "utils.h"
+
+#include "flossconverter.h"
+
+#define CONVERSION_CACHE_MAGIC 0x564e4f43 /* "CONV" */
+#define CONVERSION_CACHE_VERSION 1
+#define CONVERSION_DIGEST_SIZE 20
+
+/* CIE94 weights for textiles */
+#define CIE94_KL 2.0
+#define CIE94_K1 0.048
+#define CIE94_K2 0.014
+
+struct Lab
+{
+  double l;
+  double a;
+  double b;
+  double c;
+};
+
+static double linearize(int v)
+{
+  double c = v / 255.0;
+  if (c <= 0.04045)
+    return c / 12.92;
+
+  return std::pow((c + 0.055) / 1.055, 2.4);
+}
+
+static double labCurve(double t)
+{
+  if (t > 216.0 / 24389.0)
+    return std::pow(t, 1.0 / 3.0);
+
+  return (24389.0 / 27.0 * t + 16.0) / 116.0;
+}
+
+/* sRGB to CIELAB under D65 */
+static Lab toLab(const Color *color)
+{
+  double r = linearize(color->red());
+  double g = linearize(color->green());
+  double b = linearize(color->blue());
+
+  double x = (0.4124 * r + 0.3576 * g + 0.1805 * b) / 0.95047;
+  double y = 0.2126 * r + 0.7152 * g + 0.0722 * b;
+  double z = (0.0193 * r + 0.1192 * g + 0.9505 * b) / 1.08883;
+
+  double fx = labCurve(x);
+  double fy = labCurve(y);
+  double fz = labCurve(z);
+
+  Lab lab;
+  lab.l = 116.0 * fy - 16.0;
+  lab.a = 500.0 * (fx - fy);
+  lab.b = 200.0 * (fy - fz);
+  lab.c = std::sqrt(lab.a * lab.a + lab.b * lab.b);
+
+  return lab;
+}
+
+/* squared CIE94 difference from the reference color */
+static double difference(const Lab &reference, const Lab &sample)
+{
+  double dl = reference.l - sample.l;
+  double dc = reference.c - sample.c;
+  double da = reference.a - sample.a;
+  double db = reference.b - sample.b;
+
+  double dh2 = da * da + db * db - dc * dc;
+  if (dh2 < 0.0)
+    dh2 = 0.0;
+
+  double sc = 1.0 + CIE94_K1 * reference.c;
+  double sh = 1.0 + CIE94_K2 * reference.c;
+
+  double tl = dl / CIE94_KL;
+  double tc = dc / sc;
+
+  return tl * tl + tc * tc + dh2 / (sh * sh);
+}
+
+/* FlossConversion */
+
+FlossConversion::FlossConversion(const ColorManager *from,
+                                 const ColorManager *to)
+    : from_(from), to_(to)
+{
+  QByteArray hash = digest();
+  if (!load(hash)) {
+    build();
+    if (!save(hash))
+      qWarning("Could not write conversion cache %s",
+               qPrintable(cachePath()));
+  }
+
+  const QVector<const Color *> &source = from_->colorList();
+  const QVector<const Color *> &target = to_->colorList();
+  for (int i = 0; i < table_.size(); ++i) {
+    if (table_[i] >= 0)
+      mapping_.insert(source[i], target[table_[i]]);
+  }
+}
+
+FlossConversion::~FlossConversion()
+{
+
+}
+
+const Color* FlossConversion::convert(const Color *color) const
+{
+  return mapping_.value(color);
+}
+
+QByteArray FlossConversion::digest() const
+{
+  QCryptographicHash hash(QCryptographicHash::Sha1);
+
+  const ColorManager *sets[] = { from_, to_ };
+  for (int i = 0; i < 2; ++i) {
+    hash.addData(sets[i]->id().toUtf8());
+    foreach (const Color *c, sets[i]->colorList()) {
+      QRgb rgb = c->color().rgb();
+      hash.addData(c->id().toUtf8());
+      hash.addData(reinterpret_cast<const char *>(&rgb), sizeof(rgb));
+    }
+  }
+
+  return hash.result();
+}
+
+QString FlossConversion::cachePath() const
+{
+  QString dir = QDesktopServices::storageLocation(
+      QDesktopServices::CacheLocation);
+  if (dir.isEmpty())
+    dir = QDir::tempPath();
+
+  QByteArray key = QCryptographicHash::hash(
+      (from_->id() + "\n" + to_->id()).toUtf8(),
+      QCryptographicHash::Md5).toHex();
+
+  return QDir(dir).filePath(QString("conversion-%1.cache")
+                            .arg(QString::fromLatin1(key)));
+}
+
+void FlossConversion::build()
+{
+  const QVector<const Color *> &source = from_->colorList();
+  const QVector<const Color *> &target = to_->colorList();
+
+  QVector<Lab> targetLab(target.size());
+  for (int i = 0; i < target.size(); ++i)
+    targetLab[i] = toLab(target[i]);
+
+  table_.fill(-1, source.size());
+  for (int i = 0; i < source.size(); ++i) {
+    Lab lab = toLab(source[i]);
+
+    double best = 0.0;
+    for (int j = 0; j < target.size(); ++j) {
+      double d = difference(lab, targetLab[j]);
+      if (table_[i] < 0 || d < best) {
+        table_[i] = j;
+        best = d;
+      }
+    }
+  }
+}
+
+bool FlossConversion::load(const QByteArray &digest)
+{
+  QFile file(cachePath());
+  if (!file.open(QIODevice::ReadOnly))
+    return false;
+
+  QByteArray data = file.readAll();
+  file.close();
+
+  const int headerSize = 3 * sizeof(quint32) + CONVERSION_DIGEST_SIZE;
+  if (data.size() < headerSize)
+    return false;
+
+  quint32 header[3];
+  memcpy(header, data.constData(), sizeof(header));
+  const char *hash = data.constData() + sizeof(header);
+
+  int count = from_->colorList().size();
+  if (header[0] != CONVERSION_CACHE_MAGIC ||
+      header[1] != CONVERSION_CACHE_VERSION ||
+      header[2] != (quint32) count ||
+      data.size() != headerSize + count * (int) sizeof(qint32) ||
+      memcmp(hash, digest.constData(), CONVERSION_DIGEST_SIZE))
+    return false;
+
+  table_.resize(count);
+  memcpy(table_.data(), data.constData() + headerSize,
+         count * sizeof(qint32));
+
+  int targets = to_->colorList().size();
+  for (int i = 0; i < count; ++i) {
+    if (table_[i] >= targets) {
+      table_.clear();
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool FlossConversion::save(const QByteArray &digest) const
+{
+  QString path = cachePath();
+  if (!QDir().mkpath(QFileInfo(path).absolutePath()))
+    return false;
+
+  quint32 header[3] = {
+    CONVERSION_CACHE_MAGIC,
+    CONVERSION_CACHE_VERSION,
+    (quint32) table_.size()
+  };
+
+  QByteArray data;
+  data.append(reinterpret_cast<const char *>(header), sizeof(header));
+  data.append(digest);
+  data.append(reinterpret_cast<const char *>(table_.constData()),
+              table_.size() * sizeof(qint32));
+
+  QString temp = path + ".tmp";
+  QFile file(temp);
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    return false;
+
+  if (file.write(data) != data.size()) {
+    file.close();
+    file.remove();
+    return false;
+  }
+  file.close();
+
+  if (!Utils::replaceFile(temp, path)) {
+    QFile::remove(temp);
+    return false;
+  }
+
+  return true;
+}
+
+/* FlossConverter */
+
+FlossConverter::FlossConverter()
+{
+
+}
+
+FlossConverter::~FlossConverter()
+{
+  qDeleteAll(conversions_);
+}
+
+const FlossConversion* FlossConverter::conversion(const ColorManager *from,
+                                                  const ColorManager *to)
+{
+  ConversionKey key(from, to);
+
+  QHash<ConversionKey, FlossConversion *>::Iterator it =
+      conversions_.find(key);
+  if (it != conversions_.end())
+    return it.value();
+
+  FlossConversion *conversion = new FlossConversion(from, to);
+  conversions_.insert(key, conversion);
+
+  return conversion;
+}
+
+ColorMapping FlossConverter::mapping(const QVector<const Color *> &colors,
+                                     const ColorManager *to)
+{
+  ColorMapping result;
+
+  foreach (const Color *c, colors) {
+    const ColorManager *from = c->parent();
+    if (!from || from == to)
+      continue;
+
+    const Color *target = conversion(from, to)->convert(c);
+    if (target && target != c)
+      result.insert(c, target);
+  }
+
+  return result;
+}
@@ -0,0 +1,68 @@
+#ifndef _FLOSSCONVERTER_H_
+#define _FLOSSCONVERTER_H_
+
+#include <QByteArray>
+#include <QHash>
+#include <QPair>
+#include <QString>
+#include <QVector>
+
+#include "colormanager.h"
+
+/* Nearest colors of one color table in another.
+ *
+ * Colors are compared in CIELAB with the CIE94 difference weighted for
+ * textiles, which follows what a stitcher sees far better than RGB
+ * distance does. The table costs a full pairing of both color sets, so it
+ * is written to the cache location along with a digest of both sets and
+ * read back on later runs as long as the digest still matches. */
+class FlossConversion
+{
+ public:
+  FlossConversion(const ColorManager *from, const ColorManager *to);
+  ~FlossConversion();
+
+  const ColorManager* from() const { return from_; }
+  const ColorManager* to() const { return to_; }
+
+  /* nearest color of the target set, NULL for colors of other sets */
+  const Color* convert(const Color *color) const;
+
+ private:
+  QByteArray digest() const;
+  QString cachePath() const;
+  void build();
+  bool load(const QByteArray &digest);
+  bool save(const QByteArray &digest) const;
+
+ private:
+  const ColorManager *from_;
+  const ColorManager *to_;
+
+  /* target index per source index */
+  QVector<qint32> table_;
+  ColorMapping mapping_;
+};
+
+/* Conversion tables between color sets, built on first use. */
+class FlossConverter
+{
+ public:
+  FlossConverter();
+  ~FlossConverter();
+
+  const FlossConversion* conversion(const ColorManager *from,
+                                    const ColorManager *to);
+
+  /* target colors for the given colors, which may come from any set;
+   * colors already in the target set are left out */
+  ColorMapping mapping(const QVector<const Color *> &colors,
+                       const ColorManager *to);
+
+ private:
+  typedef QPair<const ColorManager *, const ColorManager *> ConversionKey;
+
+  QHash<ConversionKey, FlossConversion *> conversions_;
+};
+
+#endif
@@ -3,6 +3,7 @@
 #include <QUndoGroup>
 
 #include "colormanager.h"
+#include "flossconverter.h"
 #include "settings.h"
 
 #include "globalstate.h"
@@ -18,16 +19,18 @@ GlobalState::GlobalState(QObject *parent)
     colorManager_ = new MetaColorManager(COLOR_TABLE, this);
   else
     colorManager_ = new MetaColorManager(Settings::self()->colorFile());
+  flossConverter_ = new FlossConverter;
   renderingMode_ = RenderingMode_Full;
   toolMode_ = ToolMode_Full;
   color_ = NULL;
   document_ = NULL;
   undoGroup_ = new QUndoGroup(this);
+  fillDiagonal_ = false;
 }
 
 GlobalState::~GlobalState()
 {
-
+  delete flossConverter_;
 }
 
 void GlobalState::setRenderingMode(RenderingMode mode)
@@ -49,3 +52,8 @@ void GlobalState::setActiveDocument(Document *doc)
 {
   document_ = doc;
 }
+
+void GlobalState::setFillDiagonal(bool diagonal)
+{
+  fillDiagonal_ = diagonal;
+}
@@ -10,6 +10,7 @@ class QUndoGroup;
 
 class Color;
 class Document;
+class FlossConverter;
 class MetaColorManager;
 
 class GlobalState : public QObject
@@ -23,27 +24,32 @@ class GlobalState : public QObject
   ~GlobalState();
 
   MetaColorManager* colorManager() { return colorManager_; }
+  FlossConverter* flossConverter() { return flossConverter_; }
   RenderingMode renderingMode() { return renderingMode_; }
   ToolMode toolMode() { return toolMode_; }
   const Color* color() { return color_; }
   Document* activeDocument() { return document_; }
   QUndoGroup* undoGroup() { return undoGroup_; }
+  bool fillDiagonal() { return fillDiagonal_; }
   
  public slots:
   void setRenderingMode(RenderingMode mode);
   void setToolMode(ToolMode mode);
   void setColor(const Color *color);
   void setActiveDocument(Document *document);
+  void setFillDiagonal(bool diagonal);
 
  private:
   static GlobalState *instance_;
 
   MetaColorManager *colorManager_;
+  FlossConverter *flossConverter_;
   RenderingMode renderingMode_;
   ToolMode toolMode_;
   const Color *color_;
   Document *document_;
   QUndoGroup *undoGroup_;
+  bool fillDiagonal_;
 };
 
 #endif
@@ -0,0 +1,449 @@
+#include <QImageReader>
+#include <QList>
+#include <QThread>
+#include <QThreadPool>
+#include <QtConcurrentMap>
+#include <QtConcurrentRun>
+
+#include "cell.h"
+#include "colorcache.h"
+#include "document.h"
+#include "imagescaler.h"
+#include "palettereducer.h"
+#include "sparsemap.h"
+
+#include "imageimporter.h"
+
+#define IMPORT_BLOCK_ROWS 16
+
+/* reduced-size decoding keeps this many source pixels per cell and axis */
+#define IMPORT_DECODE_OVERSAMPLE 4
+
+/* amplitude of the ordered dither offset, per channel */
+#define ORDERED_DITHER_SPREAD 32.0f
+
+struct ImportBlock
+{
+  ImageImporter *importer;
+  int begin;
+  int end;
+};
+
+struct DiffusionTap
+{
+  int dx;
+  int dy;
+  float weight;
+};
+
+struct DiffusionKernel
+{
+  const DiffusionTap *taps;
+  int count;
+  int reach;
+};
+
+const DiffusionTap floydSteinbergTaps[] = {
+  {  1, 0, 7.0f / 16.0f },
+  { -1, 1, 3.0f / 16.0f },
+  {  0, 1, 5.0f / 16.0f },
+  {  1, 1, 1.0f / 16.0f }
+};
+
+const DiffusionTap atkinsonTaps[] = {
+  {  1, 0, 1.0f / 8.0f },
+  {  2, 0, 1.0f / 8.0f },
+  { -1, 1, 1.0f / 8.0f },
+  {  0, 1, 1.0f / 8.0f },
+  {  1, 1, 1.0f / 8.0f },
+  {  0, 2, 1.0f / 8.0f }
+};
+
+const DiffusionTap jarvisTaps[] = {
+  {  1, 0, 7.0f / 48.0f },
+  {  2, 0, 5.0f / 48.0f },
+  { -2, 1, 3.0f / 48.0f },
+  { -1, 1, 5.0f / 48.0f },
+  {  0, 1, 7.0f / 48.0f },
+  {  1, 1, 5.0f / 48.0f },
+  {  2, 1, 3.0f / 48.0f },
+  { -2, 2, 1.0f / 48.0f },
+  { -1, 2, 3.0f / 48.0f },
+  {  0, 2, 5.0f / 48.0f },
+  {  1, 2, 3.0f / 48.0f },
+  {  2, 2, 1.0f / 48.0f }
+};
+
+#define TAP_COUNT(taps) (sizeof(taps) / sizeof(DiffusionTap))
+
+static DiffusionKernel diffusionKernel(DitherMode mode)
+{
+  DiffusionKernel k;
+
+  switch (mode) {
+    case DitherMode_Atkinson:
+      k.taps = atkinsonTaps;
+      k.count = TAP_COUNT(atkinsonTaps);
+      k.reach = 2;
+      break;
+    case DitherMode_Jarvis:
+      k.taps = jarvisTaps;
+      k.count = TAP_COUNT(jarvisTaps);
+      k.reach = 2;
+      break;
+    case DitherMode_FloydSteinberg:
+    default:
+      k.taps = floydSteinbergTaps;
+      k.count = TAP_COUNT(floydSteinbergTaps);
+      k.reach = 1;
+      break;
+  }
+
+  return k;
+}
+
+const int bayerMatrix[8][8] = {
+  {  0, 32,  8, 40,  2, 34, 10, 42 },
+  { 48, 16, 56, 24, 50, 18, 58, 26 },
+  { 12, 44,  4, 36, 14, 46,  6, 38 },
+  { 60, 28, 52, 20, 62, 30, 54, 22 },
+  {  3, 35, 11, 43,  1, 33,  9, 41 },
+  { 51, 19, 59, 27, 49, 17, 57, 25 },
+  { 15, 47,  7, 39, 13, 45,  5, 37 },
+  { 63, 31, 55, 23, 61, 29, 53, 21 }
+};
+
+static inline byte clampChannel(float v)
+{
+  if (v <= 0.0f)
+    return 0;
+  else if (v >= 255.0f)
+    return 255;
+
+  return (byte) (v + 0.5f);
+}
+
+ImageImporter::ImageImporter(ColorManager *manager, int width,
+                             const QColor *transparentColor)
+    : width_(width), ditherMode_(DitherMode_None), maxColors_(0),
+      progress_(NULL), rowsDone_(0), rowCount_(0), canceled_(0)
+{
+  if (manager)
+    cache_ = manager->lookupCache(transparentColor);
+}
+
+ImageImporter::~ImageImporter()
+{
+
+}
+
+bool ImageImporter::run(const QImage &image)
+{
+  if (!cache_ || width_ <= 0 || image.isNull())
+    return false;
+
+  size_ = chartSize(image.size());
+  if (size_.isEmpty())
+    return false;
+
+  rowCount_ = size_.height();
+
+  return process(image);
+}
+
+bool ImageImporter::run(const QString &path)
+{
+  if (!cache_ || width_ <= 0)
+    return false;
+
+  QImageReader reader(path);
+  QSize original = reader.size();
+
+  if (!original.isValid())
+    return run(reader.read());
+
+  size_ = chartSize(original);
+  if (size_.isEmpty())
+    return false;
+
+  rowCount_ = size_.height();
+
+  if (reader.supportsOption(QImageIOHandler::ScaledSize)) {
+    QSize decoded = size_ * IMPORT_DECODE_OVERSAMPLE;
+    if (decoded.width() < original.width() &&
+        decoded.height() < original.height())
+      reader.setScaledSize(decoded);
+  }
+
+  QImage image = reader.read();
+  if (image.isNull() || isCanceled())
+    return false;
+
+  return process(image);
+}
+
+Document* ImageImporter::createDocument() const
+{
+  if (size_.isEmpty())
+    return NULL;
+
+  Document *doc = new Document(size_);
+  SparseMap *map = doc->map();
+
+  int width = size_.width();
+  int height = size_.height();
+
+  for (int y = 0; y < height; ++y) {
+    const Color * const *row = cells_.constData() + y * width;
+
+    for (int x = 0; x < width; ++x) {
+      if (!row[x])
+        continue;
+
+      Cell *cell = map->cellAt(QPoint(x, y));
+      cell->addFullStitch(row[x]);
+      cell->createGraphicsItems();
+    }
+  }
+
+  return doc;
+}
+
+QSize ImageImporter::chartSize(const QSize &source) const
+{
+  if (source.isEmpty())
+    return QSize();
+
+  int height = source.height() / (source.width() / (float) width_);
+  if (height <= 0)
+    return QSize();
+
+  return QSize(width_, height);
+}
+
+bool ImageImporter::process(const QImage &image)
+{
+  rowsDone_ = 0;
+
+  scaled_ = ImageScaler::downscale(image, size_);
+  if (scaled_.isNull() || isCanceled())
+    return false;
+
+  if (maxColors_ > 0)
+    reduce();
+
+  if (!isCanceled())
+    match();
+
+  /* the scaled copy is not needed once every cell is resolved */
+  scaled_ = QImage();
+
+  if (isCanceled()) {
+    cells_.clear();
+    size_ = QSize();
+    return false;
+  }
+
+  return true;
+}
+
+void ImageImporter::reduce()
+{
+  PaletteReducer reducer(cache_.data());
+  QVector<const Color *> colors = reducer.reduce(scaled_, maxColors_);
+
+  /* the transparent color belongs to the old table, copy it first */
+  const Color *transparent = cache_->transparent();
+  QColor transparentColor;
+  if (transparent)
+    transparentColor = transparent->color();
+
+  cache_ = ColorLookupCachePtr(
+      new ColorLookupCache(colors, transparent ? &transparentColor : NULL));
+}
+
+void ImageImporter::match()
+{
+  cells_.fill(NULL, size_.width() * size_.height());
+
+  if (ditherMode_ != DitherMode_None && ditherMode_ != DitherMode_Ordered) {
+    diffuse();
+    return;
+  }
+
+  QList<ImportBlock> blocks;
+  for (int y = 0; y < size_.height(); y += IMPORT_BLOCK_ROWS) {
+    ImportBlock block;
+    block.importer = this;
+    block.begin = y;
+    block.end = qMin(y + IMPORT_BLOCK_ROWS, size_.height());
+    blocks.append(block);
+  }
+
+  /* detach once here, workers only write disjoint rows */
+  cells_.data();
+
+  QtConcurrent::blockingMap(blocks, &ImageImporter::matchBlock);
+}
+
+void ImageImporter::matchRows(int begin, int end)
+{
+  const ColorLookupCache *cache = cache_.data();
+  const Color *transparent = cache->transparent();
+  int width = size_.width();
+  bool ordered = ditherMode_ == DitherMode_Ordered;
+
+  for (int y = begin; y < end; ++y) {
+    if (isCanceled())
+      return;
+
+    const QRgb *line = reinterpret_cast<const QRgb *>(scaled_.constScanLine(y));
+    const Color **row = cells_.data() + y * width;
+
+    for (int x = 0; x < width; ++x) {
+      QRgb pix = line[x];
+
+      if (qAlpha(pix) < IMPORT_ALPHA_THRESHOLD)
+        continue;
+
+      const Color *stitch;
+      if (ordered) {
+        float offset = ((bayerMatrix[y & 7][x & 7] + 0.5f) / 64.0f - 0.5f) *
+            ORDERED_DITHER_SPREAD;
+        stitch = cache->nearest(clampChannel(qRed(pix) + offset),
+                                clampChannel(qGreen(pix) + offset),
+                                clampChannel(qBlue(pix) + offset));
+      } else {
+        stitch = cache->nearest(pix);
+      }
+
+      if (stitch == transparent)
+        continue;
+
+      row[x] = stitch;
+    }
+
+    rowsDone_.fetchAndAddRelaxed(1);
+  }
+}
+
+void ImageImporter::diffuse()
+{
+  int height = size_.height();
+
+  error_.fill(0.0f, size_.width() * height * 3);
+  progress_ = new QAtomicInt[height];
+  nextRow_ = 0;
+
+  /* detach once here, workers only write disjoint cells */
+  cells_.data();
+  error_.data();
+
+  /* rows are claimed in order, so the row above a claimed row is always
+   * being worked on by a running thread and the wavefront cannot stall */
+  int threads = qMax(1, QThreadPool::globalInstance()->maxThreadCount());
+  QList<QFuture<void> > workers;
+  for (int i = 1; i < threads; ++i)
+    workers.append(QtConcurrent::run(this, &ImageImporter::diffuseRows));
+
+  diffuseRows();
+
+  foreach (QFuture<void> f, workers)
+    f.waitForFinished();
+
+  delete[] progress_;
+  progress_ = NULL;
+  error_ = QVector<float>();
+}
+
+void ImageImporter::diffuseRows()
+{
+  int height = size_.height();
+
+  while (!isCanceled()) {
+    int y = nextRow_.fetchAndAddOrdered(1);
+    if (y >= height)
+      break;
+
+    diffuseRow(y);
+  }
+}
+
+void ImageImporter::diffuseRow(int y)
+{
+  const ColorLookupCache *cache = cache_.data();
+  const Color *transparent = cache->transparent();
+  DiffusionKernel kernel = diffusionKernel(ditherMode_);
+  int width = size_.width();
+  int height = size_.height();
+
+  /* A row writes error at most `reach' columns to either side of the
+   * current pixel. Trailing the row above by 2 * reach + 1 columns keeps
+   * every pending contribution to a pixel finished before it is read,
+   * and keeps concurrent writers on disjoint cells. */
+  int lag = kernel.reach * 2 + 1;
+  int available = 0;
+
+  const QRgb *line = reinterpret_cast<const QRgb *>(scaled_.constScanLine(y));
+  const Color **row = cells_.data() + y * width;
+  float *error = error_.data();
+
+  for (int x = 0; x < width; ++x) {
+    if (y > 0) {
+      int needed = qMin(width, x + lag);
+      while (available < needed) {
+        available = progress_[y - 1].fetchAndAddAcquire(0);
+        if (available >= needed)
+          break;
+
+        /* the row above may have given up, so must this one */
+        if (isCanceled())
+          return;
+        QThread::yieldCurrentThread();
+      }
+    }
+
+    QRgb pix = line[x];
+
+    if (qAlpha(pix) >= IMPORT_ALPHA_THRESHOLD) {
+      float *e = error + (y * width + x) * 3;
+      byte r = clampChannel(qRed(pix) + e[0]);
+      byte g = clampChannel(qGreen(pix) + e[1]);
+      byte b = clampChannel(qBlue(pix) + e[2]);
+
+      const Color *stitch = cache->nearest(r, g, b);
+
+      if (stitch) {
+        if (stitch != transparent)
+          row[x] = stitch;
+
+        float er = r - stitch->red();
+        float eg = g - stitch->green();
+        float eb = b - stitch->blue();
+
+        for (int i = 0; i < kernel.count; ++i) {
+          const DiffusionTap &tap = kernel.taps[i];
+          int nx = x + tap.dx;
+          int ny = y + tap.dy;
+
+          if (nx < 0 || nx >= width || ny >= height)
+            continue;
+
+          float *t = error + (ny * width + nx) * 3;
+          t[0] += er * tap.weight;
+          t[1] += eg * tap.weight;
+          t[2] += eb * tap.weight;
+        }
+      }
+    }
+
+    progress_[y].fetchAndStoreRelease(x + 1);
+  }
+
+  rowsDone_.fetchAndAddRelaxed(1);
+}
+
+void ImageImporter::matchBlock(ImportBlock &block)
+{
+  block.importer->matchRows(block.begin, block.end);
+}
@@ -0,0 +1,108 @@
+#ifndef _IMAGEIMPORTER_H_
+#define _IMAGEIMPORTER_H_
+
+#include <QAtomicInt>
+#include <QColor>
+#include <QImage>
+#include <QSize>
+#include <QString>
+#include <QVector>
+
+#include "colormanager.h"
+
+class Color;
+class Document;
+
+struct ImportBlock;
+
+/* pixels less opaque than this are left empty */
+#define IMPORT_ALPHA_THRESHOLD 64
+
+enum DitherMode
+{
+  DitherMode_None,
+  DitherMode_FloydSteinberg,
+  DitherMode_Atkinson,
+  DitherMode_Jarvis,
+  DitherMode_Ordered
+};
+
+/* Image import pipeline.
+ *
+ * run() scales the source image down to the chart size in linear light,
+ * optionally
+ * narrows the color set down to the colors that represent the image best,
+ * and matches every pixel against it on the global thread pool, in blocks of
+ * rows. Error diffusion runs as a wavefront instead: each row trails the
+ * one above it by a few columns, so all rows in flight can proceed at
+ * once. run() does not touch any document, so it may be called from a
+ * worker thread, and progress() and cancel() may be called from any
+ * other thread meanwhile. createDocument() then commits the result in one
+ * pass and has to be called from the GUI thread. */
+class ImageImporter
+{
+ public:
+  ImageImporter(ColorManager *manager, int width,
+                const QColor *transparentColor = NULL);
+  ~ImageImporter();
+
+  const QSize& size() const { return size_; }
+  const QVector<const Color *>& cells() const { return cells_; }
+
+  DitherMode ditherMode() const { return ditherMode_; }
+  void setDitherMode(DitherMode mode) { ditherMode_ = mode; }
+
+  /* limits the chart to the given number of colors, 0 for no limit */
+  int maxColors() const { return maxColors_; }
+  void setMaxColors(int count) { maxColors_ = count; }
+
+  bool run(const QImage &image);
+
+  /* Reads and imports an image file. Formats that can decode at reduced
+   * size (like JPEG) are decoded at a few times the chart size only, so
+   * the full resolution source is never held in memory. */
+  bool run(const QString &path);
+
+  /* rows matched so far, out of progressMaximum(); the maximum is 0 until
+   * the chart size is known */
+  int progress() const { return rowsDone_; }
+  int progressMaximum() const { return rowCount_; }
+
+  /* makes a running run() stop early and return false */
+  void cancel() { canceled_ = 1; }
+  bool isCanceled() const { return canceled_ != 0; }
+
+  Document* createDocument() const;
+
+ private:
+  QSize chartSize(const QSize &source) const;
+  bool process(const QImage &image);
+  void reduce();
+  void match();
+  void matchRows(int begin, int end);
+  void diffuse();
+  void diffuseRows();
+  void diffuseRow(int y);
+
+  static void matchBlock(ImportBlock &block);
+
+ private:
+  ColorLookupCachePtr cache_;
+  int width_;
+  DitherMode ditherMode_;
+  int maxColors_;
+  QSize size_;
+  QImage scaled_;
+  QVector<const Color *> cells_;
+
+  /* error diffusion state */
+  QVector<float> error_;
+  QAtomicInt *progress_;
+  QAtomicInt nextRow_;
+
+  QAtomicInt rowsDone_;
+  QAtomicInt rowCount_;
+  QAtomicInt canceled_;
+};
+
+#endif
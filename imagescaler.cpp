@@ -0,0 +1,191 @@
+#include <cmath>
+
+#include <QVector>
+
+#include "imagescaler.h"
+
+#define SCALER_STRIP_ROWS 16
+#define LINEAR_STEPS 4096
+
+class GammaTables
+{
+ public:
+  GammaTables() {
+    for (int i = 0; i < 256; ++i) {
+      double c = i / 255.0;
+      if (c <= 0.04045)
+        toLinear[i] = c / 12.92;
+      else
+        toLinear[i] = pow((c + 0.055) / 1.055, 2.4);
+    }
+
+    for (int i = 0; i < LINEAR_STEPS; ++i) {
+      double l = i / (double) (LINEAR_STEPS - 1);
+      double c;
+      if (l <= 0.0031308)
+        c = l * 12.92;
+      else
+        c = 1.055 * pow(l, 1.0 / 2.4) - 0.055;
+      fromLinear[i] = (int) (c * 255.0 + 0.5);
+    }
+  }
+
+  int encode(float l) const {
+    int i = (int) (l * (LINEAR_STEPS - 1) + 0.5f);
+    if (i < 0)
+      i = 0;
+    else if (i >= LINEAR_STEPS)
+      i = LINEAR_STEPS - 1;
+    return fromLinear[i];
+  }
+
+  float toLinear[256];
+  int fromLinear[LINEAR_STEPS];
+};
+
+static const GammaTables gammaTables;
+
+/* one source column or row contributes to at most two target ones */
+struct Span
+{
+  int first;
+  float weight;
+  float rest;
+};
+
+static QVector<Span> spans(int source, int target)
+{
+  QVector<Span> result(source);
+  double ratio = target / (double) source;
+
+  for (int i = 0; i < source; ++i) {
+    double begin = i * ratio;
+    double end = (i + 1) * ratio;
+    int first = (int) begin;
+
+    Span &s = result[i];
+    s.first = first;
+    if (end > first + 1 && first + 1 < target) {
+      s.weight = (float) (first + 1 - begin);
+      s.rest = (float) (end - (first + 1));
+    } else {
+      s.weight = (float) (end - begin);
+      s.rest = 0.0f;
+    }
+  }
+
+  return result;
+}
+
+/* accumulates one row of premultiplied linear color plus alpha and weight */
+static void accumulate(float *acc, const QRgb *line, const QVector<Span> &columns,
+                       float rowWeight)
+{
+  for (int x = 0; x < columns.size(); ++x) {
+    QRgb pix = line[x];
+    float a = qAlpha(pix) / 255.0f;
+    float r = gammaTables.toLinear[qRed(pix)] * a;
+    float g = gammaTables.toLinear[qGreen(pix)] * a;
+    float b = gammaTables.toLinear[qBlue(pix)] * a;
+
+    const Span &s = columns[x];
+    float w = s.weight * rowWeight;
+    float *t = acc + s.first * 5;
+    t[0] += r * w;
+    t[1] += g * w;
+    t[2] += b * w;
+    t[3] += a * w;
+    t[4] += w;
+
+    if (s.rest > 0.0f) {
+      w = s.rest * rowWeight;
+      t += 5;
+      t[0] += r * w;
+      t[1] += g * w;
+      t[2] += b * w;
+      t[3] += a * w;
+      t[4] += w;
+    }
+  }
+}
+
+static void store(QImage &target, int y, const float *acc)
+{
+  QRgb *line = reinterpret_cast<QRgb *>(target.scanLine(y));
+
+  for (int x = 0; x < target.width(); ++x) {
+    const float *t = acc + x * 5;
+
+    if (t[3] <= 0.0f || t[4] <= 0.0f) {
+      line[x] = qRgba(0, 0, 0, 0);
+      continue;
+    }
+
+    line[x] = qRgba(gammaTables.encode(t[0] / t[3]),
+                    gammaTables.encode(t[1] / t[3]),
+                    gammaTables.encode(t[2] / t[3]),
+                    (int) (t[3] / t[4] * 255.0f + 0.5f));
+  }
+}
+
+QImage ImageScaler::downscale(const QImage &source, const QSize &size)
+{
+  if (source.isNull() || size.isEmpty())
+    return QImage();
+
+  if (size.width() >= source.width() || size.height() >= source.height())
+    return source.scaled(size, Qt::IgnoreAspectRatio, Qt::SmoothTransformation)
+        .convertToFormat(QImage::Format_ARGB32);
+
+  QImage target(size, QImage::Format_ARGB32);
+
+  QVector<Span> columns = spans(source.width(), size.width());
+  QVector<Span> rows = spans(source.height(), size.height());
+
+  /* accumulators of the current target row and the one after it */
+  QVector<float> current(size.width() * 5, 0.0f);
+  QVector<float> next(size.width() * 5, 0.0f);
+  int currentRow = 0;
+
+  bool direct = source.format() == QImage::Format_ARGB32 ||
+      source.format() == QImage::Format_RGB32;
+
+  for (int y = 0; y < source.height(); y += SCALER_STRIP_ROWS) {
+    int count = qMin(SCALER_STRIP_ROWS, source.height() - y);
+
+    QImage strip;
+    if (!direct)
+      strip = source.copy(0, y, source.width(), count)
+          .convertToFormat(QImage::Format_ARGB32);
+
+    for (int i = 0; i < count; ++i) {
+      const Span &s = rows[y + i];
+
+      while (currentRow < s.first) {
+        store(target, currentRow, current.constData());
+        current = next;
+        next.fill(0.0f);
+        ++currentRow;
+      }
+
+      const QRgb *line;
+      if (direct)
+        line = reinterpret_cast<const QRgb *>(source.constScanLine(y + i));
+      else
+        line = reinterpret_cast<const QRgb *>(strip.constScanLine(i));
+
+      accumulate(current.data(), line, columns, s.weight);
+      if (s.rest > 0.0f)
+        accumulate(next.data(), line, columns, s.rest);
+    }
+  }
+
+  while (currentRow < size.height()) {
+    store(target, currentRow, current.constData());
+    current = next;
+    next.fill(0.0f);
+    ++currentRow;
+  }
+
+  return target;
+}
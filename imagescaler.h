@@ -0,0 +1,20 @@
+#ifndef _IMAGESCALER_H_
+#define _IMAGESCALER_H_
+
+#include <QImage>
+#include <QSize>
+
+class ImageScaler
+{
+ public:
+  /* Area-averaging downscale in linear light.
+   *
+   * The source is consumed a strip of rows at a time and only two rows
+   * of accumulators are kept, so besides the source itself memory use is
+   * bounded by the target size. Colors are averaged after conversion
+   * from sRGB to linear intensity and weighted by alpha. Enlarging falls
+   * back to QImage::scaled(). The result is always ARGB32. */
+  static QImage downscale(const QImage &source, const QSize &size);
+};
+
+#endif
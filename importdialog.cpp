@@ -1,16 +1,34 @@
 #include <QColorDialog>
+#include <QImageReader>
+#include <QPixmap>
+#include <QTimer>
+#include <QtConcurrentRun>
 
+#include "color.h"
 #include "colormanager.h"
 #include "globalstate.h"
+#include "imagescaler.h"
 
 #include "importdialog.h"
 
-ImportDialog::ImportDialog(const QImage &image,
+/* largest side of the cached preview source, matches the chart size limit */
+#define PREVIEW_SOURCE_SIZE 1000
+
+/* quiet time after a settings change before the preview is rendered */
+#define PREVIEW_DELAY 150
+
+ImportDialog::ImportDialog(const QString &path, const QSize &imageSize,
 			   QWidget *parent)
     : QDialog(parent), Ui::ImportDialog()
 {
   setupUi(this);
 
+  previewImporter_ = NULL;
+  previewPending_ = false;
+  previewTimer_ = new QTimer(this);
+  previewTimer_->setSingleShot(true);
+  previewTimer_->setInterval(PREVIEW_DELAY);
+
   connect(Ui::ImportDialog::width, SIGNAL(valueChanged(int)),
 	  this, SLOT(setWidth(int)));
   connect(Ui::ImportDialog::height, SIGNAL(valueChanged(int)),
@@ -18,8 +36,27 @@ ImportDialog::ImportDialog(const QImage &image,
   connect(Ui::ImportDialog::transparentColor, SIGNAL(released()),
 	  this, SLOT(selectColor()));
 
+  connect(Ui::ImportDialog::width, SIGNAL(valueChanged(int)),
+	  this, SLOT(schedulePreview()));
+  connect(Ui::ImportDialog::height, SIGNAL(valueChanged(int)),
+	  this, SLOT(schedulePreview()));
+  connect(colorSet, SIGNAL(currentIndexChanged(int)),
+	  this, SLOT(schedulePreview()));
+  connect(transparent, SIGNAL(toggled(bool)),
+	  this, SLOT(schedulePreview()));
+  connect(dithering, SIGNAL(currentIndexChanged(int)),
+	  this, SLOT(schedulePreview()));
+  connect(maxColors, SIGNAL(valueChanged(int)),
+	  this, SLOT(schedulePreview()));
+  connect(previewTimer_, SIGNAL(timeout()),
+	  this, SLOT(startPreview()));
+  connect(&sourceWatcher_, SIGNAL(finished()),
+	  this, SLOT(sourceLoaded()));
+  connect(&previewWatcher_, SIGNAL(finished()),
+	  this, SLOT(previewFinished()));
+
   transparentColor_ = QColor(255, 255, 255);
-  origsize_ = image.size();
+  origsize_ = imageSize;
 
   if (origsize_.height() > origsize_.width())
     setHeight(60);
@@ -33,10 +70,21 @@ ImportDialog::ImportDialog(const QImage &image,
     colorSet->insertSeparator(colorSet->count());
     colorSet->addItem(mcm->localSwatches()->name(), "");
   }
+
+  sourceWatcher_.setFuture(QtConcurrent::run(&ImportDialog::loadPreviewSource,
+                                             path));
 }
 
 ImportDialog::~ImportDialog()
 {
+  if (previewImporter_)
+    previewImporter_->cancel();
+
+  sourceWatcher_.waitForFinished();
+  previewWatcher_.waitForFinished();
+
+  if (previewImporter_)
+    delete previewImporter_;
 
 }
 
@@ -78,6 +126,27 @@ const QColor& ImportDialog::transparentColor() const
   return transparentColor_;
 }
 
+DitherMode ImportDialog::ditherMode() const
+{
+  switch (dithering->currentIndex()) {
+    case 1:
+      return DitherMode_FloydSteinberg;
+    case 2:
+      return DitherMode_Atkinson;
+    case 3:
+      return DitherMode_Jarvis;
+    case 4:
+      return DitherMode_Ordered;
+    default:
+      return DitherMode_None;
+  }
+}
+
+int ImportDialog::colorLimit() const
+{
+  return maxColors->value();
+}
+
 void ImportDialog::setWidth(int v)
 {
   int adjustedh = origsize_.height() / (origsize_.width() / (float) v);
@@ -124,4 +193,115 @@ void ImportDialog::selectColor()
 
   transparentColor_ = cd.selectedColor();
   Ui::ImportDialog::transparentColor->setText(transparentColor_.name());
+
+  schedulePreview();
+}
+
+void ImportDialog::schedulePreview()
+{
+  if (previewImporter_)
+    previewImporter_->cancel();
+
+  previewTimer_->start();
+}
+
+void ImportDialog::startPreview()
+{
+  /* sourceLoaded() and previewFinished() come back here */
+  if (source_.isNull() || previewWatcher_.isRunning()) {
+    previewPending_ = true;
+    return;
+  }
+
+  previewPending_ = false;
+
+  ColorManager *manager = colorManager();
+  if (!manager)
+    return;
+
+  previewImporter_ = new ImageImporter(manager, documentWidth(),
+                                       hasTransparent() ? &transparentColor_ : NULL);
+  previewImporter_->setDitherMode(ditherMode());
+  previewImporter_->setMaxColors(colorLimit());
+
+  previewWatcher_.setFuture(QtConcurrent::run(&ImportDialog::renderPreview,
+                                              previewImporter_, source_));
+}
+
+void ImportDialog::sourceLoaded()
+{
+  source_ = sourceWatcher_.result();
+
+  if (source_.isNull()) {
+    preview->setText(tr("No preview"));
+    return;
+  }
+
+  startPreview();
+}
+
+void ImportDialog::previewFinished()
+{
+  QImage image = previewWatcher_.result();
+
+  delete previewImporter_;
+  previewImporter_ = NULL;
+
+  if (previewPending_) {
+    startPreview();
+    return;
+  }
+
+  if (image.isNull())
+    return;
+
+  preview->setPixmap(QPixmap::fromImage(
+      image.scaled(preview->contentsRect().size(), Qt::KeepAspectRatio,
+                   Qt::FastTransformation)));
+}
+
+QImage ImportDialog::loadPreviewSource(const QString &path)
+{
+  QImageReader reader(path);
+  QSize size = reader.size();
+  QSize bound(PREVIEW_SOURCE_SIZE, PREVIEW_SOURCE_SIZE);
+
+  if (size.isValid() && reader.supportsOption(QImageIOHandler::ScaledSize) &&
+      (size.width() > bound.width() || size.height() > bound.height())) {
+    size.scale(bound, Qt::KeepAspectRatio);
+    reader.setScaledSize(size);
+  }
+
+  QImage image = reader.read();
+  if (image.width() > bound.width() || image.height() > bound.height()) {
+    size = image.size();
+    size.scale(bound, Qt::KeepAspectRatio);
+    image = ImageScaler::downscale(image, size);
+  }
+
+  return image;
+}
+
+QImage ImportDialog::renderPreview(ImageImporter *importer, const QImage &source)
+{
+  if (!importer->run(source))
+    return QImage();
+
+  QImage image(importer->size(), QImage::Format_ARGB32);
+  image.fill(0);
+
+  const QVector<const Color *> &cells = importer->cells();
+  int width = image.width();
+
+  for (int y = 0; y < image.height(); ++y) {
+    QRgb *line = reinterpret_cast<QRgb *>(image.scanLine(y));
+    const Color * const *row = cells.constData() + y * width;
+
+    for (int x = 0; x < width; ++x) {
+      if (row[x])
+        line[x] = row[x]->color().rgb();
+    }
+  }
+
+  return image;
 }
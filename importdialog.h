@@ -2,10 +2,15 @@
 #define _IMPORTDIALOG_H_
 
 #include <QDialog>
+#include <QFutureWatcher>
 #include <QImage>
+#include <QSize>
 
+#include "imageimporter.h"
 #include "ui_importdialog.h"
 
+class QTimer;
+
 class ColorManager;
 
 class ImportDialog : public QDialog, public Ui::ImportDialog
@@ -13,7 +18,8 @@ class ImportDialog : public QDialog, public Ui::ImportDialog
   Q_OBJECT;
 
  public:
-  ImportDialog(const QImage &image, QWidget *parent = NULL);
+  ImportDialog(const QString &path, const QSize &imageSize,
+               QWidget *parent = NULL);
   ~ImportDialog();
 
   int documentWidth() const;
@@ -22,6 +28,8 @@ class ImportDialog : public QDialog, public Ui::ImportDialog
   ColorManager* colorManager() const;
   bool hasTransparent() const;
   const QColor& transparentColor() const;
+  DitherMode ditherMode() const;
+  int colorLimit() const;
 
  public slots:
   void setWidth(int v);
@@ -29,10 +37,28 @@ class ImportDialog : public QDialog, public Ui::ImportDialog
 
  private slots:
   void selectColor();
+  void schedulePreview();
+  void startPreview();
+  void sourceLoaded();
+  void previewFinished();
+
+ private:
+  static QImage loadPreviewSource(const QString &path);
+  static QImage renderPreview(ImageImporter *importer, const QImage &source);
 
  private:
   QSize origsize_;
   QColor transparentColor_;
+
+  /* The preview matches a copy of the image that is downscaled once, on
+   * a worker. Settings changes are debounced, and a change while a preview
+   * is rendering cancels it and renders again once it has stopped. */
+  QImage source_;
+  QFutureWatcher<QImage> sourceWatcher_;
+  QFutureWatcher<QImage> previewWatcher_;
+  ImageImporter *previewImporter_;
+  QTimer *previewTimer_;
+  bool previewPending_;
 };
 
 #endif
@@ -0,0 +1,401 @@
+#include <algorithm>
+
+#include <QDataStream>
+#include <QDateTime>
+#include <QFileInfo>
+#include <QRect>
+#include <QtAlgorithms>
+
+#include "cell.h"
+#include "color.h"
+#include "colormanager.h"
+#include "document.h"
+#include "editor.h"
+#include "globalstate.h"
+#include "sparsemap.h"
+#include "tileloader.h"
+#include "utils.h"
+
+#include "journal.h"
+
+#define JOURNAL_VERSION 1
+#define JOURNAL_HEADER_SIZE (JOURNAL_MAGIC_SIZE + 16)
+
+#define JOURNAL_RECORD_COLOR 1
+#define JOURNAL_RECORD_CELLS 2
+#define JOURNAL_RECORD_SAVE 3
+
+/* journals up to this size never force a full save */
+#define JOURNAL_MIN_COMPACT (64 * 1024)
+
+static quint32 zigzag(int v)
+{
+  return ((quint32) v << 1) ^ (quint32) (v >> 31);
+}
+
+static int unzigzag(quint32 v)
+{
+  return (int) (v >> 1) ^ -(int) (v & 1);
+}
+
+static void putString(QByteArray &out, const QString &s)
+{
+  QByteArray utf8 = s.toUtf8();
+  Utils::putVarint(out, utf8.size());
+  out.append(utf8);
+}
+
+static bool getString(const uchar *&p, const uchar *end, QString &s)
+{
+  quint32 length;
+  if (!Utils::getVarint(p, end, length) || (quint32) (end - p) < length)
+    return false;
+
+  s = QString::fromUtf8(reinterpret_cast<const char *>(p), length);
+  p += length;
+
+  return true;
+}
+
+Journal::Journal(QObject *parent)
+    : QObject(parent), document_(NULL), baseSize_(0), baseTime_(0),
+      savedSize_(0), failed_(false)
+{
+
+}
+
+Journal::~Journal()
+{
+
+}
+
+QString Journal::path(const QString &name)
+{
+  return name + ".journal";
+}
+
+void Journal::open(Document *doc, bool create)
+{
+  start(doc, true, create);
+}
+
+void Journal::reset(Document *doc)
+{
+  start(doc, false, true);
+}
+
+void Journal::close()
+{
+  if (!document_)
+    return;
+
+  disconnect(document_->editor(), SIGNAL(indexChanged(int)),
+             this, SLOT(record()));
+
+  ColorUsageTracker *tracker = document_->colorTracker();
+  tracker->setRecording(false);
+  tracker->takeTouched();
+
+  if (file_.isOpen()) {
+    if (!failed_)
+      file_.resize(savedSize_);
+    file_.close();
+  }
+
+  document_ = NULL;
+  palette_.clear();
+  paletteIndex_.clear();
+}
+
+bool Journal::save()
+{
+  if (!document_ || failed_)
+    return false;
+
+  /* past this, replaying on open costs more than a rewrite now */
+  if (file_.size() > qMax((qint64) JOURNAL_MIN_COMPACT, baseSize_ / 2))
+    return false;
+
+  record();
+  append(JOURNAL_RECORD_SAVE, QByteArray());
+  if (failed_)
+    return false;
+
+  savedSize_ = file_.size();
+  return true;
+}
+
+void Journal::record()
+{
+  if (!document_)
+    return;
+
+  QVector<QPoint> touched = document_->colorTracker()->takeTouched();
+  if (touched.isEmpty())
+    return;
+
+  qSort(touched.begin(), touched.end());
+  touched.erase(std::unique(touched.begin(), touched.end()), touched.end());
+
+  const CellMap &cells = document_->map()->cells();
+  QByteArray payload;
+  QPoint last;
+
+  Utils::putVarint(payload, touched.size());
+  foreach (const QPoint &pos, touched) {
+    const Cell *cell = cells.value(pos);
+    int mask = cell ? cell->featureMask() : 0;
+
+    Utils::putVarint(payload, zigzag(pos.x() - last.x()));
+    Utils::putVarint(payload, zigzag(pos.y() - last.y()));
+    Utils::putVarint(payload, mask);
+    for (int i = 0; i < CELL_COUNT; ++i) {
+      if (mask & (1 << i))
+        Utils::putVarint(payload, paletteIndex(cell->color(i)));
+    }
+
+    last = pos;
+  }
+
+  append(JOURNAL_RECORD_CELLS, payload);
+}
+
+void Journal::start(Document *doc, bool replay, bool create)
+{
+  close();
+
+  QFileInfo base(doc->name());
+  if (doc->name().isEmpty() || !base.exists())
+    return;
+
+  document_ = doc;
+  baseSize_ = base.size();
+  baseTime_ = base.lastModified().toTime_t();
+  failed_ = false;
+  file_.setFileName(path(doc->name()));
+
+  qint64 validSize = 0;
+  bool unsaved = false;
+  if (replay && file_.open(QIODevice::ReadOnly)) {
+    QByteArray data = file_.readAll();
+    file_.close();
+
+    /* a journal of another version of the file does not apply */
+    if (data.startsWith(header()))
+      this->replay(data, validSize, unsaved);
+  }
+
+  if (validSize == 0 && !create) {
+    document_ = NULL;
+    return;
+  }
+
+  bool ok;
+  if (validSize > 0) {
+    /* cut off a record torn by a crash */
+    ok = QFile::resize(file_.fileName(), validSize) &&
+        file_.open(QIODevice::WriteOnly | QIODevice::Append);
+  } else {
+    palette_.clear();
+    paletteIndex_.clear();
+    savedSize_ = JOURNAL_HEADER_SIZE;
+
+    QByteArray head = header();
+    ok = file_.open(QIODevice::WriteOnly | QIODevice::Truncate) &&
+        file_.write(head) == head.size() && file_.flush();
+  }
+
+  if (!ok) {
+    qWarning("Could not open the journal %s", qPrintable(file_.fileName()));
+    file_.close();
+    document_ = NULL;
+    return;
+  }
+
+  connect(doc->editor(), SIGNAL(indexChanged(int)), this, SLOT(record()));
+
+  ColorUsageTracker *tracker = doc->colorTracker();
+  tracker->takeTouched();
+  tracker->setRecording(true);
+
+  if (unsaved)
+    doc->setChanged(true);
+}
+
+bool Journal::replay(const QByteArray &data, qint64 &validSize, bool &unsaved)
+{
+  const uchar *begin = reinterpret_cast<const uchar *>(data.constData());
+  const uchar *end = begin + data.size();
+  const uchar *p = begin + JOURNAL_HEADER_SIZE;
+  const MetaColorManager *meta = GlobalState::self()->colorManager();
+
+  validSize = savedSize_ = JOURNAL_HEADER_SIZE;
+  unsaved = false;
+
+  while (p < end) {
+    int type = *p++;
+    quint32 length;
+    if (!Utils::getVarint(p, end, length) ||
+        (quint32) (end - p) < length + 2)
+      break;
+
+    const char *payload = reinterpret_cast<const char *>(p);
+    quint16 sum = (p[length] << 8) | p[length + 1];
+    if (qChecksum(payload, length) != sum)
+      break;
+    p += length + 2;
+
+    bool ok = true;
+    switch (type) {
+      case JOURNAL_RECORD_COLOR: {
+        const uchar *q = reinterpret_cast<const uchar *>(payload);
+        const uchar *qend = q + length;
+        QString category, id;
+        ok = getString(q, qend, category) && getString(q, qend, id);
+        if (ok) {
+          const Color *color = meta->get(category, id);
+          paletteIndex_.insert(color, palette_.size());
+          palette_.append(color);
+        }
+        break;
+      }
+      case JOURNAL_RECORD_CELLS:
+        ok = applyCells(QByteArray::fromRawData(payload, length));
+        unsaved = true;
+        break;
+      case JOURNAL_RECORD_SAVE:
+        savedSize_ = p - begin;
+        unsaved = false;
+        break;
+      default:
+        ok = false;
+        break;
+    }
+
+    if (!ok)
+      break;
+
+    validSize = p - begin;
+  }
+
+  return validSize == data.size();
+}
+
+bool Journal::applyCells(const QByteArray &payload)
+{
+  const uchar *p = reinterpret_cast<const uchar *>(payload.constData());
+  const uchar *end = p + payload.size();
+
+  quint32 count;
+  if (!Utils::getVarint(p, end, count))
+    return false;
+
+  /* the whole record is checked before any of it is applied */
+  DecodedTile cells;
+  QRect region;
+  QPoint pos;
+  for (quint32 i = 0; i < count; ++i) {
+    quint32 dx, dy, mask;
+    if (!Utils::getVarint(p, end, dx) || !Utils::getVarint(p, end, dy) ||
+        !Utils::getVarint(p, end, mask) || mask >> CELL_COUNT)
+      return false;
+
+    pos += QPoint(unzigzag(dx), unzigzag(dy));
+    for (int f = 0; f < CELL_COUNT; ++f) {
+      if (!(mask & (1 << f)))
+        continue;
+
+      quint32 index;
+      if (!Utils::getVarint(p, end, index) ||
+          index >= (quint32) palette_.size())
+        return false;
+      cells.colors.append(palette_[index]);
+    }
+
+    cells.positions.append(pos);
+    cells.masks.append(mask);
+    region |= QRect(pos, QSize(1, 1));
+  }
+
+  document_->ensureLoaded(region);
+
+  SparseMap *map = document_->map();
+  int k = 0;
+  for (int i = 0; i < cells.positions.size(); ++i) {
+    int mask = cells.masks[i];
+    if (!mask) {
+      map->remove(cells.positions[i]);
+      continue;
+    }
+
+    Cell *c = map->cellAt(cells.positions[i]);
+    if (!c) {
+      for (int f = 0; f < CELL_COUNT; ++f)
+        k += (mask >> f) & 1;
+      continue;
+    }
+
+    for (int f = 0; f < CELL_COUNT; ++f)
+      c->remove(f);
+    for (int f = 0; f < CELL_COUNT; ++f) {
+      if (mask & (1 << f))
+        c->addFeature(f, cells.colors[k++]);
+    }
+    c->createGraphicsItems();
+  }
+
+  return true;
+}
+
+int Journal::paletteIndex(const Color *color)
+{
+  QHash<const Color *, int>::ConstIterator it = paletteIndex_.find(color);
+  if (it != paletteIndex_.end())
+    return it.value();
+
+  QByteArray payload;
+  putString(payload, color && color->parent() ? color->parent()->id() :
+            QString());
+  putString(payload, color ? color->id() : QString());
+  append(JOURNAL_RECORD_COLOR, payload);
+
+  int index = palette_.size();
+  palette_.append(color);
+  paletteIndex_.insert(color, index);
+
+  return index;
+}
+
+void Journal::append(int type, const QByteArray &payload)
+{
+  if (failed_)
+    return;
+
+  QByteArray record;
+  record.append((char) type);
+  Utils::putVarint(record, payload.size());
+  record.append(payload);
+
+  quint16 sum = qChecksum(payload.constData(), payload.size());
+  record.append((char) (sum >> 8));
+  record.append((char) (sum & 0xff));
+
+  if (file_.write(record) != record.size() || !file_.flush()) {
+    failed_ = true;
+    qWarning("Could not write to the journal %s",
+             qPrintable(file_.fileName()));
+  }
+}
+
+QByteArray Journal::header() const
+{
+  QByteArray data;
+  QDataStream stream(&data, QIODevice::WriteOnly);
+  stream.setVersion(QDataStream::Qt_4_6);
+
+  stream.writeRawData(JOURNAL_MAGIC, JOURNAL_MAGIC_SIZE);
+  stream << (quint32) JOURNAL_VERSION << (qint64) baseSize_
+         << (quint32) baseTime_;
+
+  return data;
+}
@@ -0,0 +1,85 @@
+#ifndef _JOURNAL_H_
+#define _JOURNAL_H_
+
+#include <QByteArray>
+#include <QFile>
+#include <QHash>
+#include <QObject>
+#include <QString>
+#include <QVector>
+
+class Color;
+class Document;
+
+/* first bytes of a journal file, followed by its version */
+#define JOURNAL_MAGIC "STJL"
+#define JOURNAL_MAGIC_SIZE 4
+
+/* Append-only log of the edits made to a document since its file was
+ * last written in full.
+ *
+ * The journal lives next to the document as "<file>.journal". After
+ * every change of the undo stack, the final state of each cell the
+ * change touched is appended as one record: varint deltas of the
+ * positions, feature masks and indexes into a palette that the journal
+ * extends with color records as needed. Saving appends a save mark, so
+ * a save costs in proportion to the edits since the last one. Records
+ * carry a checksum, and a torn record at the end is cut off on replay.
+ *
+ * The header names the size and modification time of the file the
+ * journal applies to, so a journal left behind by another version of the
+ * file is ignored. A full save starts a new, empty journal. */
+class Journal : public QObject
+{
+  Q_OBJECT;
+
+ public:
+  Journal(QObject *parent = NULL);
+  ~Journal();
+
+  Document* document() const { return document_; }
+
+  /* journal file of a document file */
+  static QString path(const QString &name);
+
+  /* Replays the journal of a document just read from its file, then
+   * records its edits. Edits that were never saved, left by a crash,
+   * mark the document as changed. Without a journal to replay, a new one
+   * is started only when create is set. */
+  void open(Document *doc, bool create = true);
+
+  /* starts an empty journal for a document whose file was just written */
+  void reset(Document *doc);
+
+  /* stops recording and drops the edits made since the last save */
+  void close();
+
+  /* appends a save mark; false when the journal cannot stand in for a
+   * full save, because it is not recording, failed to write or has grown
+   * past what rewriting the document costs */
+  bool save();
+
+ private slots:
+  void record();
+
+ private:
+  void start(Document *doc, bool replay, bool create);
+  bool replay(const QByteArray &data, qint64 &validSize, bool &unsaved);
+  bool applyCells(const QByteArray &payload);
+  int paletteIndex(const Color *color);
+  void append(int type, const QByteArray &payload);
+  QByteArray header() const;
+
+ private:
+  Document *document_;
+  QFile file_;
+  qint64 baseSize_;
+  uint baseTime_;
+  qint64 savedSize_;
+  bool failed_;
+
+  QVector<const Color *> palette_;
+  QHash<const Color *, int> paletteIndex_;
+};
+
+#endif
@@ -0,0 +1,428 @@
+#include <cstring>
+
+#include <QIODevice>
+
+#include "jsonstream.h"
+
+/* JsonReader */
+
+JsonReader::JsonReader(QIODevice *device)
+    : device_(device), pos_(0), error_(false), number_(0.0)
+{
+
+}
+
+JsonReader::~JsonReader()
+{
+
+}
+
+bool JsonReader::fill()
+{
+  if (pos_ < buffer_.size())
+    return true;
+
+  buffer_ = device_->read(JSON_STREAM_BUFFER);
+  pos_ = 0;
+
+  return !buffer_.isEmpty();
+}
+
+int JsonReader::peekChar()
+{
+  if (!fill())
+    return -1;
+
+  return (uchar) buffer_[pos_];
+}
+
+int JsonReader::getChar()
+{
+  if (!fill())
+    return -1;
+
+  return (uchar) buffer_[pos_++];
+}
+
+int JsonReader::skipSpace()
+{
+  for (;;) {
+    int c = peekChar();
+    if (c != ' ' && c != '\t' && c != '\n' && c != '\r')
+      return c;
+    ++pos_;
+  }
+}
+
+JsonToken JsonReader::fail()
+{
+  error_ = true;
+  return JsonToken_Error;
+}
+
+JsonToken JsonReader::next()
+{
+  if (error_)
+    return JsonToken_Error;
+
+  int c;
+  do {
+    c = skipSpace();
+    if (c == ',' || c == ':')
+      ++pos_;
+  } while (c == ',' || c == ':');
+
+  if (c < 0)
+    return JsonToken_End;
+
+  ++pos_;
+  switch (c) {
+    case '{':
+      return JsonToken_BeginObject;
+    case '}':
+      return JsonToken_EndObject;
+    case '[':
+      return JsonToken_BeginArray;
+    case ']':
+      return JsonToken_EndArray;
+    case '"':
+      if (!readString())
+        return fail();
+      return skipSpace() == ':' ? JsonToken_Key : JsonToken_String;
+    case 't':
+      return readLiteral("rue") ? JsonToken_True : fail();
+    case 'f':
+      return readLiteral("alse") ? JsonToken_False : fail();
+    case 'n':
+      return readLiteral("ull") ? JsonToken_Null : fail();
+    default:
+      if (c == '-' || (c >= '0' && c <= '9'))
+        return readNumber(c) ? JsonToken_Number : fail();
+      return fail();
+  }
+}
+
+bool JsonReader::skip(JsonToken token)
+{
+  if (token != JsonToken_BeginObject && token != JsonToken_BeginArray)
+    return token != JsonToken_Error && token != JsonToken_End;
+
+  int depth = 1;
+  while (depth > 0) {
+    switch (next()) {
+      case JsonToken_BeginObject:
+      case JsonToken_BeginArray:
+        ++depth;
+        break;
+      case JsonToken_EndObject:
+      case JsonToken_EndArray:
+        --depth;
+        break;
+      case JsonToken_End:
+      case JsonToken_Error:
+        return false;
+      default:
+        break;
+    }
+  }
+
+  return true;
+}
+
+bool JsonReader::readRaw(JsonToken token, QByteArray &out)
+{
+  if (token != JsonToken_BeginObject && token != JsonToken_BeginArray)
+    return false;
+
+  out.append(token == JsonToken_BeginObject ? '{' : '[');
+
+  int depth = 1;
+  bool quoted = false, escaped = false;
+  while (depth > 0) {
+    if (!fill()) {
+      error_ = true;
+      return false;
+    }
+
+    /* copy up to the closing bracket or the end of the buffer */
+    const char *begin = buffer_.constData() + pos_;
+    const char *end = buffer_.constData() + buffer_.size();
+    const char *p = begin;
+    for (; p < end && depth > 0; ++p) {
+      char c = *p;
+      if (quoted) {
+        if (escaped)
+          escaped = false;
+        else if (c == '\\')
+          escaped = true;
+        else if (c == '"')
+          quoted = false;
+      } else if (c == '"') {
+        quoted = true;
+      } else if (c == '{' || c == '[') {
+        ++depth;
+      } else if (c == '}' || c == ']') {
+        --depth;
+      }
+    }
+    out.append(begin, p - begin);
+    pos_ += p - begin;
+  }
+
+  return true;
+}
+
+/* hex digit value, -1 if none */
+static int hexValue(int c)
+{
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+
+  return -1;
+}
+
+bool JsonReader::readString()
+{
+  /* UTF-8 runs are collected as bytes and decoded at the next \u escape
+   * or at the end; escapes only ever split the text at ASCII characters */
+  string_.clear();
+  bytes_.clear();
+
+  for (;;) {
+    if (!fill())
+      return false;
+
+    /* copy the plain run up to the next quote or escape in one go */
+    const char *begin = buffer_.constData() + pos_;
+    const char *end = buffer_.constData() + buffer_.size();
+    const char *p = begin;
+    while (p < end && *p != '"' && *p != '\\')
+      ++p;
+    bytes_.append(begin, p - begin);
+    pos_ += p - begin;
+
+    int c = getChar();
+    if (c < 0)
+      continue;
+    if (c == '"')
+      break;
+
+    c = getChar();
+    switch (c) {
+      case '"': bytes_.append('"'); break;
+      case '\\': bytes_.append('\\'); break;
+      case '/': bytes_.append('/'); break;
+      case 'b': bytes_.append('\b'); break;
+      case 'f': bytes_.append('\f'); break;
+      case 'n': bytes_.append('\n'); break;
+      case 'r': bytes_.append('\r'); break;
+      case 't': bytes_.append('\t'); break;
+      case 'u': {
+        ushort unit = 0;
+        for (int i = 0; i < 4; ++i) {
+          int v = hexValue(getChar());
+          if (v < 0)
+            return false;
+          unit = (unit << 4) | v;
+        }
+        string_ += QString::fromUtf8(bytes_.constData(), bytes_.size());
+        string_ += QChar(unit);
+        bytes_.clear();
+        break;
+      }
+      default:
+        return false;
+    }
+  }
+
+  string_ += QString::fromUtf8(bytes_.constData(), bytes_.size());
+  return true;
+}
+
+bool JsonReader::readNumber(int first)
+{
+  char text[64];
+  int length = 0;
+  text[length++] = first;
+
+  for (;;) {
+    int c = peekChar();
+    if (!((c >= '0' && c <= '9') || c == '.' || c == 'e' || c == 'E' ||
+          c == '+' || c == '-'))
+      break;
+    if (length == (int) sizeof(text) - 1)
+      return false;
+
+    text[length++] = c;
+    ++pos_;
+  }
+  text[length] = '\0';
+
+  bool ok;
+  number_ = QByteArray::fromRawData(text, length).toDouble(&ok);
+
+  return ok;
+}
+
+bool JsonReader::readLiteral(const char *rest)
+{
+  for (const char *p = rest; *p; ++p) {
+    if (getChar() != *p)
+      return false;
+  }
+
+  return true;
+}
+
+/* JsonWriter */
+
+JsonWriter::JsonWriter(QIODevice *device)
+    : device_(device), afterKey_(false), error_(false)
+{
+  buffer_.reserve(JSON_STREAM_BUFFER);
+}
+
+JsonWriter::~JsonWriter()
+{
+  flush();
+}
+
+void JsonWriter::beginObject()
+{
+  open('{');
+}
+
+void JsonWriter::endObject()
+{
+  close('}');
+}
+
+void JsonWriter::beginArray()
+{
+  open('[');
+}
+
+void JsonWriter::endArray()
+{
+  close(']');
+}
+
+void JsonWriter::key(const QString &name)
+{
+  separate();
+  writeString(name);
+  append(": ", 2);
+  afterKey_ = true;
+}
+
+void JsonWriter::value(const QString &s)
+{
+  separate();
+  writeString(s);
+}
+
+void JsonWriter::value(int i)
+{
+  separate();
+
+  QByteArray text = QByteArray::number(i);
+  append(text.constData(), text.size());
+}
+
+void JsonWriter::null()
+{
+  separate();
+  append("null", 4);
+}
+
+bool JsonWriter::flush()
+{
+  if (!buffer_.isEmpty()) {
+    if (device_->write(buffer_) != buffer_.size())
+      error_ = true;
+    buffer_.clear();
+  }
+
+  return !error_;
+}
+
+void JsonWriter::separate()
+{
+  if (afterKey_) {
+    afterKey_ = false;
+    return;
+  }
+
+  if (first_.isEmpty())
+    return;
+
+  if (first_.last())
+    first_.last() = false;
+  else
+    append(", ", 2);
+}
+
+void JsonWriter::open(char c)
+{
+  separate();
+  append(&c, 1);
+  first_.append(true);
+}
+
+void JsonWriter::close(char c)
+{
+  first_.pop_back();
+  append(&c, 1);
+}
+
+void JsonWriter::writeString(const QString &s)
+{
+  QByteArray out;
+  out.reserve(s.size() + 2);
+  out.append('"');
+
+  const QChar *p = s.constData();
+  for (int i = 0; i < s.size(); ++i) {
+    ushort u = p[i].unicode();
+    switch (u) {
+      case '"': out.append("\\\""); break;
+      case '\\': out.append("\\\\"); break;
+      case '\b': out.append("\\b"); break;
+      case '\f': out.append("\\f"); break;
+      case '\n': out.append("\\n"); break;
+      case '\r': out.append("\\r"); break;
+      case '\t': out.append("\\t"); break;
+      default:
+        if (u < 0x20) {
+          char escape[7];
+          qsnprintf(escape, sizeof(escape), "\\u%04x", u);
+          out.append(escape);
+        } else if (u < 0x80) {
+          out.append((char) u);
+        } else {
+          /* non-ASCII text goes out as UTF-8 */
+          int j = i;
+          while (j < s.size() && p[j].unicode() >= 0x80)
+            ++j;
+          out.append(QString(p + i, j - i).toUtf8());
+          i = j - 1;
+        }
+        break;
+    }
+  }
+
+  out.append('"');
+  append(out.constData(), out.size());
+}
+
+void JsonWriter::append(const char *data, int size)
+{
+  buffer_.append(data, size);
+
+  if (buffer_.size() >= JSON_STREAM_BUFFER)
+    flush();
+}
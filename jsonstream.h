@@ -0,0 +1,114 @@
+#ifndef _JSONSTREAM_H_
+#define _JSONSTREAM_H_
+
+#include <QByteArray>
+#include <QString>
+#include <QVector>
+
+class QIODevice;
+
+/* bytes read from or written to the device at once */
+#define JSON_STREAM_BUFFER (64 * 1024)
+
+enum JsonToken
+{
+  JsonToken_BeginObject,
+  JsonToken_EndObject,
+  JsonToken_BeginArray,
+  JsonToken_EndArray,
+  JsonToken_Key,
+  JsonToken_String,
+  JsonToken_Number,
+  JsonToken_True,
+  JsonToken_False,
+  JsonToken_Null,
+  JsonToken_End,
+  JsonToken_Error
+};
+
+/* Pull parser for JSON.
+ *
+ * Tokens are read straight off the device through a fixed buffer, so a
+ * document is never held in memory as a whole, neither as text nor as a
+ * variant tree. Commas and colons are consumed silently; a string
+ * followed by a colon is reported as a key. */
+class JsonReader
+{
+ public:
+  JsonReader(QIODevice *device);
+  ~JsonReader();
+
+  JsonToken next();
+
+  /* text of the last key or string, value of the last number */
+  const QString& string() const { return string_; }
+  double number() const { return number_; }
+  int integer() const { return (int) number_; }
+
+  /* skips the value whose first token was just read */
+  bool skip(JsonToken token);
+
+  /* appends the text of the object or array whose first token was just
+   * read to out, without parsing it beyond matching the brackets */
+  bool readRaw(JsonToken token, QByteArray &out);
+
+  bool hasError() const { return error_; }
+
+ private:
+  bool fill();
+  int peekChar();
+  int getChar();
+  int skipSpace();
+  JsonToken fail();
+  bool readString();
+  bool readNumber(int first);
+  bool readLiteral(const char *rest);
+
+ private:
+  QIODevice *device_;
+  QByteArray buffer_;
+  int pos_;
+  bool error_;
+
+  QString string_;
+  QByteArray bytes_;
+  double number_;
+};
+
+/* Streaming JSON writer, the counterpart of JsonReader. */
+class JsonWriter
+{
+ public:
+  JsonWriter(QIODevice *device);
+  ~JsonWriter();
+
+  void beginObject();
+  void endObject();
+  void beginArray();
+  void endArray();
+
+  void key(const QString &name);
+  void value(const QString &s);
+  void value(int i);
+  void null();
+
+  /* writes out what is buffered, false if the device failed at any
+   * point */
+  bool flush();
+
+ private:
+  void separate();
+  void open(char c);
+  void close(char c);
+  void writeString(const QString &s);
+  void append(const char *data, int size);
+
+ private:
+  QIODevice *device_;
+  QByteArray buffer_;
+  QVector<bool> first_;
+  bool afterKey_;
+  bool error_;
+};
+
+#endif
@@ -11,10 +11,12 @@ KdNode::KdNode(ColorListItr begin, ColorListItr end, int depth)
   right_ = NULL;
   color_ = NULL;
 
-  if (begin == end)
+  if (begin == end) {
     return;
-  else if (end - begin == 1)
+  } else if (end - begin == 1) {
+    color_ = *begin;
     return;
+  }
 
   int dim = depth % 3;
   if (dim == 0)
@@ -65,10 +67,18 @@ KdTree::~KdTree()
   delete root_;
 }
 
-const Color* KdTree::nearest(const QColor &color)
+const Color* KdTree::nearest(const QColor &color) const
+{
+  return nearest(color.red(), color.green(), color.blue());
+}
+
+const Color* KdTree::nearest(byte red, byte green, byte blue) const
 {
   const Color *min = root_->color_;
-  byte array[] = { color.red(), color.green(), color.blue() };
+  if (!min)
+    return NULL;
+
+  byte array[] = { red, green, blue };
 
   return nearest(root_, array, min);
 }
@@ -85,12 +95,14 @@ int KdTree::distance(byte a[], const Color *b)
   return dr * dr + dg * dg + db * db;
 }
 
-const Color* KdTree::nearest(KdNode *node, byte color[], const Color *&min, int depth)
+const Color* KdTree::nearest(KdNode *node, byte color[], const Color *&min, int depth) const
 {
   if (node) {
     int axis = depth % 3;
-    byte mincolors[] = { min->red(), min->green(), min->blue() };
-    int dist = color[axis] - mincolors[axis];
+    byte split[] = { node->color_->red(),
+                     node->color_->green(),
+                     node->color_->blue() };
+    int dist = color[axis] - split[axis];
     KdNode *near = dist <= 0 ? node->left_ : node->right_;
     KdNode *far = dist <= 0 ? node->right_ : node->left_;
 
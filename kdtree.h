@@ -53,12 +53,13 @@ class KdTree
   KdTree(ColorListItr begin, ColorListItr end);
   ~KdTree();
 
-  const Color* nearest(const QColor &color);
+  const Color* nearest(const QColor &color) const;
+  const Color* nearest(byte red, byte green, byte blue) const;
 
  private:
   static int distance(byte a[], const Color *b);
   const Color* nearest(KdNode *node, byte color[],
-		       const Color *&min, int depth = 0);
+		       const Color *&min, int depth = 0) const;
 
   KdNode *root_;
 };
@@ -0,0 +1,121 @@
+#include <climits>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "color.h"
+
+#include "linearsearch.h"
+
+/* distance of padding entries stays above any real color distance */
+#define PADDING_VALUE 1000
+
+LinearColorSearch::LinearColorSearch(const QVector<const Color *> &colors)
+    : colors_(colors)
+{
+  groups_ = (colors_.size() + 3) / 4;
+
+  int length = qMax(groups_, 1) * 8;
+  rg_ = static_cast<qint16 *>(qMallocAligned(length * sizeof(qint16), 16));
+  b_ = static_cast<qint16 *>(qMallocAligned(length * sizeof(qint16), 16));
+
+  for (int i = 0; i < groups_ * 4; ++i) {
+    qint16 *rg = rg_ + (i / 4) * 8 + (i % 4) * 2;
+    qint16 *b = b_ + (i / 4) * 8 + (i % 4) * 2;
+
+    if (i < colors_.size()) {
+      const Color *c = colors_[i];
+      rg[0] = c->red();
+      rg[1] = c->green();
+      b[0] = c->blue();
+    } else {
+      rg[0] = PADDING_VALUE;
+      rg[1] = PADDING_VALUE;
+      b[0] = PADDING_VALUE;
+    }
+    b[1] = 0;
+  }
+}
+
+LinearColorSearch::~LinearColorSearch()
+{
+  qFreeAligned(rg_);
+  qFreeAligned(b_);
+}
+
+const Color* LinearColorSearch::nearest(byte red, byte green, byte blue) const
+{
+  int index = nearestIndex(red, green, blue);
+  if (index < 0)
+    return NULL;
+
+  return colors_[index];
+}
+
+int LinearColorSearch::nearestIndex(byte red, byte green, byte blue) const
+{
+  if (colors_.isEmpty())
+    return -1;
+
+#ifdef __SSE2__
+  const __m128i prg = _mm_set_epi16(green, red, green, red,
+                                    green, red, green, red);
+  const __m128i pb = _mm_set_epi16(0, blue, 0, blue, 0, blue, 0, blue);
+  const __m128i step = _mm_set1_epi32(4);
+
+  __m128i best = _mm_set1_epi32(INT_MAX);
+  __m128i bestIndex = _mm_setzero_si128();
+  __m128i index = _mm_set_epi32(3, 2, 1, 0);
+
+  for (int i = 0; i < groups_; ++i) {
+    __m128i drg = _mm_sub_epi16(
+        _mm_load_si128(reinterpret_cast<const __m128i *>(rg_ + i * 8)), prg);
+    __m128i db = _mm_sub_epi16(
+        _mm_load_si128(reinterpret_cast<const __m128i *>(b_ + i * 8)), pb);
+    __m128i dist = _mm_add_epi32(_mm_madd_epi16(drg, drg),
+                                 _mm_madd_epi16(db, db));
+
+    __m128i closer = _mm_cmplt_epi32(dist, best);
+    best = _mm_or_si128(_mm_and_si128(closer, dist),
+                        _mm_andnot_si128(closer, best));
+    bestIndex = _mm_or_si128(_mm_and_si128(closer, index),
+                             _mm_andnot_si128(closer, bestIndex));
+    index = _mm_add_epi32(index, step);
+  }
+
+  int dists[4];
+  int indices[4];
+  _mm_storeu_si128(reinterpret_cast<__m128i *>(dists), best);
+  _mm_storeu_si128(reinterpret_cast<__m128i *>(indices), bestIndex);
+
+  int min = 0;
+  for (int i = 1; i < 4; ++i) {
+    if (dists[i] < dists[min] ||
+        (dists[i] == dists[min] && indices[i] < indices[min]))
+      min = i;
+  }
+
+  return indices[min];
+#else
+  int best = INT_MAX;
+  int bestIndex = 0;
+
+  for (int i = 0; i < colors_.size(); ++i) {
+    const qint16 *rg = rg_ + (i / 4) * 8 + (i % 4) * 2;
+    const qint16 *b = b_ + (i / 4) * 8 + (i % 4) * 2;
+
+    int dr = rg[0] - red;
+    int dg = rg[1] - green;
+    int db = b[0] - blue;
+    int dist = dr * dr + dg * dg + db * db;
+
+    if (dist < best) {
+      best = dist;
+      bestIndex = i;
+    }
+  }
+
+  return bestIndex;
+#endif
+}
@@ -0,0 +1,42 @@
+#ifndef _LINEARSEARCH_H_
+#define _LINEARSEARCH_H_
+
+#include <QVector>
+
+#include "common.h"
+
+class Color;
+
+/* Palettes up to this size are scanned linearly instead of using a
+ * kd-tree. Measured with -O2 and SSE2 on random palettes and uniformly
+ * random pixels, the scan takes about half the time of the kd-tree at 462
+ * colors, is still ahead at 768 and breaks even near 1000; the limit
+ * keeps a margin below that. */
+#define LINEAR_SEARCH_LIMIT 512
+
+/* Brute-force nearest color search.
+ *
+ * The palette is kept as 16-bit integer arrays laid out for SSE2: every
+ * group of four entries stores interleaved red/green pairs followed by
+ * blue/zero pairs, so one multiply-add evaluates four squared distances
+ * at once. Builds without SSE2 use a plain scalar loop over the same
+ * data. */
+class LinearColorSearch
+{
+ public:
+  LinearColorSearch(const QVector<const Color *> &colors);
+  ~LinearColorSearch();
+
+  const Color* nearest(byte red, byte green, byte blue) const;
+  int nearestIndex(byte red, byte green, byte blue) const;
+
+  int count() const { return colors_.size(); }
+
+ private:
+  QVector<const Color *> colors_;
+  qint16 *rg_;
+  qint16 *b_;
+  int groups_;
+};
+
+#endif
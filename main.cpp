@@ -1,17 +1,49 @@
+#include <stdio.h>
+#include <string.h>
+
 #include <QApplication>
 
+#include "batchconverter.h"
 #include "common.h"
+#include "globalstate.h"
 #include "mainwindow.h"
+#include "settings.h"
+
+static int runBatch(const QStringList &args)
+{
+  Settings settings;
+  GlobalState state;
+  BatchConverter converter;
+
+  QString error;
+  if (!converter.parseArguments(args, error)) {
+    fprintf(stderr, "%s\n\n%s", qPrintable(error),
+            qPrintable(BatchConverter::usage()));
+    return 2;
+  }
+
+  return converter.run() ? 1 : 0;
+}
 
 int main(int argc, char *argv[])
 {
-  QApplication app(argc, argv);
+  bool batch = false;
+  for (int i = 1; i < argc; ++i) {
+    if (!strcmp(argv[i], "--batch"))
+      batch = true;
+  }
+
+  /* batch mode never shows a window, so it does not need a display */
+  QApplication app(argc, argv, !batch);
 
   QCoreApplication::setOrganizationName("Influx");
   QCoreApplication::setOrganizationDomain("influx.kr");
   QCoreApplication::setApplicationName("Stitchy");
   QCoreApplication::setApplicationVersion(VERSION);
 
+  if (batch)
+    return runBatch(app.arguments());
+
   MainWindow mw;
   mw.show();
 
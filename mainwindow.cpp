@@ -1,27 +1,42 @@
 #include <QApplication>
 #include <QClipboard>
 #include <QCloseEvent>
+#include <QDateTime>
 #include <QDockWidget>
+#include <QFile>
 #include <QFileDialog>
 #include <QFileInfo>
 #include <QGraphicsView>
+#include <QImageReader>
+#include <QInputDialog>
 #include <QMenuBar>
 #include <QMessageBox>
+#include <QProgressDialog>
+#include <QTimer>
 #include <QToolBar>
 #include <QUndoGroup>
+#include <QtConcurrentRun>
 
+#include "autosaver.h"
 #include "canvas.h"
 #include "color.h"
 #include "coloreditor.h"
+#include "confetticleaner.h"
 #include "document.h"
 #include "documentio.h"
 #include "documentpropertiesdialog.h"
+#include "editor.h"
+#include "editoractions.h"
+#include "flossconverter.h"
 #include "globalstate.h"
+#include "imageimporter.h"
 #include "importdialog.h"
+#include "journal.h"
 #include "newdocumentdialog.h"
 #include "palettewidget.h"
 #include "selectiongroup.h"
 #include "settings.h"
+#include "statisticswidget.h"
 #include "utils.h"
 
 #include "mainwindow.h"
@@ -32,6 +47,13 @@ MainWindow::MainWindow(QWidget *parent)
   settings_ = new Settings();
   state_ = new GlobalState(this);
   clipboard_ = QApplication::clipboard();
+  autosaver_ = new Autosaver(this);
+  journal_ = new Journal(this);
+
+  importer_ = NULL;
+  importProgress_ = NULL;
+  importTimer_ = new QTimer(this);
+  importTimer_->setInterval(100);
 
   initWidgets();
   initActions();
@@ -50,11 +72,20 @@ MainWindow::MainWindow(QWidget *parent)
     restoreGeometry(geometry);
 
   setActiveDocument(NULL);
+  restoreDocument(QString());
 }
 
 MainWindow::~MainWindow()
 {
+  if (importer_) {
+    importer_->cancel();
+    importWatcher_.waitForFinished();
+    delete importer_;
+  }
+
   if (state_->activeDocument()) {
+    autosaver_->discard();
+    journal_->close();
     delete state_->activeDocument();
     state_->setActiveDocument(NULL);
   }
@@ -92,7 +123,7 @@ void MainWindow::openFile()
       QString(),
       tr("Stitchy Document (*.stitchy)"));
 
-  if (!path.isEmpty()) {
+  if (!path.isEmpty() && !restoreDocument(path)) {
     QString error;
     Document *doc = DocumentFactory::load(path, error);
     if (!doc) {
@@ -100,12 +131,18 @@ void MainWindow::openFile()
     } else {
       doc->setName(path);
       setActiveDocument(doc);
+      /* edits in an existing journal are part of the document even when
+       * journaling was turned off since */
+      journal_->open(doc, settings_->journal());
     }
   }
 }
 
 void MainWindow::importFile()
 {
+  if (importer_)
+    return;
+
   closeFile();
 
   QString path = QFileDialog::getOpenFileName(
@@ -115,14 +152,18 @@ void MainWindow::importFile()
       tr("Image Files (*.png *.jpg *.bmp)"));
 
   if (!path.isEmpty()) {
-    QImage image(path);
+    /* only the header is read here, the image is decoded by the importer */
+    QImageReader reader(path);
+    QSize size = reader.size();
+    if (!size.isValid())
+      size = reader.read().size();
 
-    if (image.isNull()) {
+    if (size.isEmpty()) {
       QMessageBox::critical(this, tr("Error"), tr("Error loading image file."));
       return;
     }
 
-    ImportDialog diag(image, this);
+    ImportDialog diag(path, size, this);
     diag.show();
     diag.exec();
 
@@ -133,17 +174,69 @@ void MainWindow::importFile()
     if (diag.hasTransparent())
       transparentColor = &diag.transparentColor();
 
-    Document *doc = DocumentFactory::load(image, 
-					  diag.colorManager(),
-					  diag.documentWidth(),
-					  transparentColor);
-    if (!doc) {
-      QMessageBox::critical(this, tr("Error"), tr("Error loading file."));
-    } else {
-      doc->setTitle(diag.title());
-      doc->setAuthor(diag.author());
-      setActiveDocument(doc);
-    }
+    importer_ = new ImageImporter(diag.colorManager(), diag.documentWidth(),
+                                  transparentColor);
+    importer_->setDitherMode(diag.ditherMode());
+    importer_->setMaxColors(diag.colorLimit());
+    importTitle_ = diag.title();
+    importAuthor_ = diag.author();
+
+    importProgress_ = new QProgressDialog(tr("Importing image..."),
+                                          tr("Cancel"), 0, 0, this);
+    importProgress_->setWindowModality(Qt::WindowModal);
+    importProgress_->setMinimumDuration(500);
+    importProgress_->setAutoReset(false);
+    importProgress_->setAutoClose(false);
+    connect(importProgress_, SIGNAL(canceled()), this, SLOT(cancelImport()));
+
+    bool (ImageImporter::*run)(const QString &) = &ImageImporter::run;
+    importWatcher_.setFuture(QtConcurrent::run(importer_, run, path));
+    importTimer_->start();
+  }
+}
+
+void MainWindow::updateImportProgress()
+{
+  if (!importer_ || !importProgress_)
+    return;
+
+  importProgress_->setMaximum(importer_->progressMaximum());
+  importProgress_->setValue(importer_->progress());
+}
+
+void MainWindow::cancelImport()
+{
+  if (importer_)
+    importer_->cancel();
+}
+
+void MainWindow::importFinished()
+{
+  importTimer_->stop();
+
+  if (!importer_)
+    return;
+
+  bool canceled = importer_->isCanceled();
+
+  /* the scene and its items belong to the GUI thread, so the finished
+   * cell grid is committed here */
+  Document *doc = NULL;
+  if (importWatcher_.result())
+    doc = importer_->createDocument();
+
+  delete importer_;
+  importer_ = NULL;
+
+  importProgress_->deleteLater();
+  importProgress_ = NULL;
+
+  if (doc) {
+    doc->setTitle(importTitle_);
+    doc->setAuthor(importAuthor_);
+    setActiveDocument(doc);
+  } else if (!canceled) {
+    QMessageBox::critical(this, tr("Error"), tr("Error loading file."));
   }
 }
 
@@ -154,6 +247,7 @@ void MainWindow::closeFile()
 
   if (state_->activeDocument()) {
     Document *doc = state_->activeDocument();
+    autosaver_->discard();
     setActiveDocument(NULL);
     delete doc;
   }
@@ -205,6 +299,110 @@ void MainWindow::showColorEditor()
   dialog->show();
 }
 
+void MainWindow::removeConfetti()
+{
+  Document *doc = state_->activeDocument();
+  if (!doc)
+    return;
+
+  bool ok;
+  int size = QInputDialog::getInt(this, tr("Remove Confetti"),
+                                  tr("Merge color regions smaller than:"),
+                                  3, 2, 1000, 1, &ok);
+  if (!ok)
+    return;
+
+  doc->ensureLoaded();
+  ConfettiCleaner cleaner(doc);
+  if (!cleaner.run(size)) {
+    QMessageBox::information(this, tr("Remove Confetti"),
+                             tr("No regions smaller than %1 stitches.").arg(size));
+    return;
+  }
+
+  doc->editor()->edit(new ActionCleanup(doc, cleaner.positions(),
+                                        cleaner.from(), cleaner.to()));
+}
+
+void MainWindow::replaceColor()
+{
+  Document *doc = state_->activeDocument();
+  const Color *to = state_->color();
+  if (!doc)
+    return;
+
+  if (!to) {
+    QMessageBox::information(this, tr("Replace Color"),
+                             tr("Select the new color in the palette first."));
+    return;
+  }
+
+  doc->ensureLoaded();
+  const QVector<const Color *> &used = doc->colorTracker()->colorList();
+  QStringList names;
+  foreach (const Color *c, used)
+    names << tr("%1 %2").arg(c->id()).arg(c->name());
+
+  if (names.isEmpty())
+    return;
+
+  bool ok;
+  QString name = QInputDialog::getItem(
+      this, tr("Replace Color"),
+      tr("Replace this color with %1 %2:").arg(to->id()).arg(to->name()),
+      names, 0, false, &ok);
+  if (!ok)
+    return;
+
+  const Color *from = used[names.indexOf(name)];
+  if (from == to)
+    return;
+
+  ActionReplaceColor *action = new ActionReplaceColor(doc, from, to);
+  if (action->isEmpty()) {
+    delete action;
+    return;
+  }
+
+  doc->editor()->edit(action);
+}
+
+void MainWindow::convertColors()
+{
+  Document *doc = state_->activeDocument();
+  if (!doc)
+    return;
+
+  QList<ColorManager *> &sets = state_->colorManager()->colorManagers();
+  QStringList names;
+  foreach (const ColorManager *cm, sets)
+    names << cm->name();
+
+  if (names.isEmpty())
+    return;
+
+  bool ok;
+  QString name = QInputDialog::getItem(
+      this, tr("Convert to Color Set"),
+      tr("Convert the colors of this chart to:"),
+      names, 0, false, &ok);
+  if (!ok)
+    return;
+
+  const ColorManager *to = sets[names.indexOf(name)];
+  doc->ensureLoaded();
+  ColorMapping mapping = state_->flossConverter()->mapping(
+      doc->colorTracker()->colorList(), to);
+
+  ActionConvertColors *action = new ActionConvertColors(doc, mapping);
+  if (action->isEmpty()) {
+    delete action;
+    return;
+  }
+
+  doc->editor()->edit(action);
+}
+
 void MainWindow::toolModeAction(QAction *action)
 {
   ToolMode t;
@@ -228,6 +426,8 @@ void MainWindow::toolModeAction(QAction *action)
     t = ToolMode_Petite;
   else if (action == actionModeDrawQuarter_)
     t = ToolMode_Quarter;
+  else if (action == actionModeFill_)
+    t = ToolMode_Fill;
   else
     return;
 
@@ -268,6 +468,9 @@ void MainWindow::setActiveDocument(Document *document)
     disconnectConnections(state_->activeDocument());
 
   state_->setActiveDocument(document);
+  autosaver_->setDocument(document);
+  if (journal_->document() != document)
+    journal_->close();
 
   if (state_->activeDocument()) {
     setEnabled(documentActions_, true);
@@ -310,7 +513,7 @@ void MainWindow::clipboardChanged()
   const QMimeData *data = clipboard_->mimeData();
 
   if (state_->activeDocument() && data &&
-      data->hasFormat(SelectionGroup::mimeType()))
+      SelectionGroup::canDecode(data))
     actionPaste_->setEnabled(true);
   else
     actionPaste_->setEnabled(false);
@@ -388,6 +591,14 @@ bool MainWindow::saveDocument(bool newName)
   if (activeDocument->name().isEmpty())
     newName = true;
 
+  /* with a journal, saving only marks the edits journaled so far */
+  if (!newName && settings_->journal() &&
+      journal_->document() == activeDocument && journal_->save()) {
+    autosaver_->discard();
+    activeDocument->setChanged(false);
+    return true;
+  }
+
   QString filename;
   if (newName) {
     filename = QFileDialog::getSaveFileName(
@@ -405,9 +616,62 @@ bool MainWindow::saveDocument(bool newName)
     return false;
   }
 
+  autosaver_->discard();
   activeDocument->setName(filename);
   activeDocument->setChanged(false);
 
+  /* the file holds everything now, so the journal starts over */
+  if (settings_->journal()) {
+    journal_->reset(activeDocument);
+  } else {
+    journal_->close();
+    QFile::remove(Journal::path(filename));
+  }
+
+  return true;
+}
+
+bool MainWindow::restoreDocument(const QString &name)
+{
+  QString recovery = Autosaver::recoveryPath(name);
+  QFileInfo info(recovery);
+  if (!info.exists())
+    return false;
+
+  /* a recovery copy older than the file or its journal was saved over
+   * already */
+  if (!name.isEmpty()) {
+    QDateTime saved = QFileInfo(name).lastModified();
+    QFileInfo journal(Journal::path(name));
+    if (journal.exists() && journal.lastModified() > saved)
+      saved = journal.lastModified();
+    if (info.lastModified() < saved)
+      return false;
+  }
+
+  QString title = name.isEmpty() ? tr("an untitled document") :
+      QFileInfo(name).fileName();
+  if (QMessageBox::question(
+          this, tr("Recover"),
+          tr("Stitchy did not exit cleanly while editing %1. Do you want to "
+             "recover the unsaved changes?").arg(title),
+          QMessageBox::Yes | QMessageBox::No,
+          QMessageBox::Yes) != QMessageBox::Yes) {
+    QFile::remove(recovery);
+    return false;
+  }
+
+  QString error;
+  Document *doc = DocumentFactory::load(recovery, error);
+  if (!doc) {
+    QMessageBox::critical(this, tr("Error"), tr("Error loading file: %1").arg(error));
+    return false;
+  }
+
+  doc->setName(name);
+  doc->setChanged(true);
+  setActiveDocument(doc);
+
   return true;
 }
 
@@ -479,6 +743,16 @@ void MainWindow::initActions()
                               QKeySequence::Paste,
                               Utils::icon("edit-paste"));
   clipboardChanged();
+  actionReplaceColor_ = createAction(tr("&Replace Color..."),
+                                     this,
+                                     SLOT(replaceColor()),
+                                     QKeySequence(),
+                                     QIcon());
+  actionConvertColors_ = createAction(tr("Con&vert to Color Set..."),
+                                      this,
+                                      SLOT(convertColors()),
+                                      QKeySequence(),
+                                      QIcon());
   actionDeleteSelected_ = createAction(tr("&Delete Selected"),
                                        canvas_,
                                        SLOT(deleteSelected()),
@@ -547,8 +821,15 @@ void MainWindow::initActions()
   actionModeDrawQuarter_ = createAction(tr("&Quarter Stitch"),
                                         QKeySequence("F10"),
                                         Utils::icon("stitch-quarter"));
+  actionModeFill_ = createAction(tr("F&ill"),
+                                 QKeySequence("F11"),
+                                 Utils::icon("color-fill"));
   actionModeDrawFull_->setChecked(true);
 
+  actionFillDiagonal_ = createAction(tr("Fill &Diagonally"),
+                                     QKeySequence(),
+                                     QIcon());
+
   actionGroupMode_ = new QActionGroup(this);
   actionGroupMode_->addAction(actionModeSelect_);
   actionGroupMode_->addAction(actionModeMove_);
@@ -558,7 +839,14 @@ void MainWindow::initActions()
   actionGroupMode_->addAction(actionModeDrawHalf_);
   actionGroupMode_->addAction(actionModeDrawPetite_);
   actionGroupMode_->addAction(actionModeDrawQuarter_);
+  actionGroupMode_->addAction(actionModeFill_);
   actionGroupMode_->setExclusive(true);
+
+  actionRemoveConfetti_ = createAction(tr("Remove &Confetti..."),
+                                       this,
+                                       SLOT(removeConfetti()),
+                                       QKeySequence(),
+                                       QIcon());
   
   actionColorEditor_ = createAction(tr("&Colors..."),
                                     this,
@@ -579,7 +867,8 @@ void MainWindow::initActions()
 
   documentActions_ << actionCloseFile_ << actionSaveFile_ <<
       actionSaveFileAs_ << actionZoomIn_ << actionZoomOut_ <<
-      actionZoomReset_;
+      actionZoomReset_ << actionRemoveConfetti_ << actionReplaceColor_ <<
+      actionConvertColors_;
   selectionActions_ << actionCut_ << actionCopy_ <<
       actionDeleteSelected_;
 }
@@ -607,6 +896,8 @@ void MainWindow::initMenus()
   menuEdit_->addAction(actionPaste_);
   menuEdit_->addSeparator();;
   menuEdit_->addAction(actionDeleteSelected_);
+  menuEdit_->addAction(actionReplaceColor_);
+  menuEdit_->addAction(actionConvertColors_);
 
   menuView_ = menuBar()->addMenu(tr("&View"));
   menuView_->addAction(actionZoomOut_);
@@ -628,9 +919,14 @@ void MainWindow::initMenus()
   menuTool_->addAction(actionModeDrawHalf_);
   menuTool_->addAction(actionModeDrawPetite_);
   menuTool_->addAction(actionModeDrawQuarter_);
+  menuTool_->addAction(actionModeFill_);
+  menuTool_->addAction(actionFillDiagonal_);
+  menuTool_->addSeparator();
+  menuTool_->addAction(actionRemoveConfetti_);
 
   menuWindow_ = menuBar()->addMenu(tr("&Window"));
   menuWindow_->addAction(actionColorEditor_);
+  menuWindow_->addAction(statisticsDock_->toggleViewAction());
 
   menuHelp_ = menuBar()->addMenu(tr("&Help"));
   menuHelp_->addAction(actionAbout_);
@@ -682,6 +978,7 @@ void MainWindow::initToolbars()
   toolBarTool->addAction(actionModeDrawHalf_);
   toolBarTool->addAction(actionModeDrawPetite_);
   toolBarTool->addAction(actionModeDrawQuarter_);
+  toolBarTool->addAction(actionModeFill_);
 }
 
 void MainWindow::initWidgets()
@@ -694,6 +991,12 @@ void MainWindow::initWidgets()
                            QDockWidget::DockWidgetFloatable);
   addDockWidget(Qt::LeftDockWidgetArea, paletteDock);
 
+  statistics_ = new StatisticsWidget;
+  statisticsDock_ = new QDockWidget(tr("Statistics"));
+  statisticsDock_->setObjectName("statistics");
+  statisticsDock_->setWidget(statistics_);
+  addDockWidget(Qt::RightDockWidgetArea, statisticsDock_);
+
   canvas_ = new Canvas(this);
   setCentralWidget(canvas_);
 }
@@ -708,6 +1011,8 @@ void MainWindow::initConnections()
           this, SLOT(showColorEditor()));
   connect(this, SIGNAL(documentChanged(Document *)),
           palette_, SLOT(documentChanged(Document *)));
+  connect(this, SIGNAL(documentChanged(Document *)),
+          statistics_, SLOT(documentChanged(Document *)));
   connect(this, SIGNAL(documentChanged(Document *)),
           this, SLOT(documentChangeAction(Document*)));
   connect(actionGroupMode_, SIGNAL(triggered(QAction *)),
@@ -716,12 +1021,18 @@ void MainWindow::initConnections()
           this, SLOT(viewModeAction(QAction *)));
   connect(actionViewGrids_, SIGNAL(toggled(bool)),
           canvas_, SLOT(toggleGrid(bool)));
+  connect(actionFillDiagonal_, SIGNAL(toggled(bool)),
+          state_, SLOT(setFillDiagonal(bool)));
   connect(canvas_, SIGNAL(madeSelection(const QRect &)),
           this, SLOT(selectionChanged(const QRect &)));
   connect(canvas_, SIGNAL(clearedSelection()),
           this, SLOT(selectionCleared()));
   connect(clipboard_, SIGNAL(dataChanged()),
           this, SLOT(clipboardChanged()));
+  connect(importTimer_, SIGNAL(timeout()),
+          this, SLOT(updateImportProgress()));
+  connect(&importWatcher_, SIGNAL(finished()),
+          this, SLOT(importFinished()));
 }
 
 void MainWindow::initConnections(Document *doc)
@@ -3,17 +3,26 @@
 
 #include <QMainWindow>
 
+#include <QFutureWatcher>
+
 class QActionGroup;
 class QClipboard;
 class QCloseEvent;
+class QDockWidget;
 class QMenu;
+class QProgressDialog;
+class QTimer;
 
+class Autosaver;
 class Canvas;
 class Document;
 class GlobalState;
+class ImageImporter;
+class Journal;
 class MetaColorManager;
 class PaletteWidget;
 class Settings;
+class StatisticsWidget;
 
 class MainWindow : public QMainWindow
 {
@@ -31,6 +40,9 @@ class MainWindow : public QMainWindow
   void newFile();
   void openFile();
   void importFile();
+  void updateImportProgress();
+  void cancelImport();
+  void importFinished();
   void closeFile();
   void saveFile();
   void saveFileAs();
@@ -38,6 +50,9 @@ class MainWindow : public QMainWindow
   void about();
   void viewModeAction(QAction *action);
   void showColorEditor();
+  void removeConfetti();
+  void replaceColor();
+  void convertColors();
   void toolModeAction(QAction *action);
   void updateTitle();
   void setActiveDocument(Document *document);
@@ -55,6 +70,7 @@ class MainWindow : public QMainWindow
   void closeEvent(QCloseEvent *event);
   bool confirmClose();
   bool saveDocument(bool newName);
+  bool restoreDocument(const QString &name);
   void setEnabled(QList<QAction *> &actions, bool enabled);
 
   void initWidgets();
@@ -67,10 +83,22 @@ class MainWindow : public QMainWindow
 
  private:
   PaletteWidget *palette_;
+  StatisticsWidget *statistics_;
+  QDockWidget *statisticsDock_;
   Canvas *canvas_;
   Settings *settings_;
   GlobalState *state_;
   QClipboard *clipboard_;
+  Autosaver *autosaver_;
+  Journal *journal_;
+
+  /* running image import */
+  ImageImporter *importer_;
+  QFutureWatcher<bool> importWatcher_;
+  QProgressDialog *importProgress_;
+  QTimer *importTimer_;
+  QString importTitle_;
+  QString importAuthor_;
 
   QMenu *menuFile_;
   QMenu *menuEdit_;
@@ -96,6 +124,8 @@ class MainWindow : public QMainWindow
   QAction *actionPaste_;
   QAction *actionDeleteSelected_;
   QAction *actionDocumentProperties_;
+  QAction *actionReplaceColor_;
+  QAction *actionConvertColors_;
 
   /* view actions */
   QAction *actionZoomIn_;
@@ -117,6 +147,9 @@ class MainWindow : public QMainWindow
   QAction *actionModeDrawHalf_;
   QAction *actionModeDrawPetite_;
   QAction *actionModeDrawQuarter_;
+  QAction *actionModeFill_;
+  QAction *actionFillDiagonal_;
+  QAction *actionRemoveConfetti_;
 
   /* window actions */
   QAction *actionColorEditor_;
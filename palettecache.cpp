@@ -0,0 +1,236 @@
+#include <cstring>
+
+#include <QCryptographicHash>
+#include <QDesktopServices>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QVector>
+
+#include "color.h"
+#include "colormanager.h"
+#include "utils.h"
+
+#include "palettecache.h"
+
+#define PALETTE_CACHE_MAGIC 0x4c415053 /* "SPAL" */
+#define PALETTE_CACHE_VERSION 1
+#define PALETTE_CACHE_DIGEST_SIZE 20
+
+struct PaletteCacheHeader
+{
+  quint32 magic;
+  quint32 version;
+  char digest[PALETTE_CACHE_DIGEST_SIZE];
+  quint32 setCount;
+  quint32 colorCount;
+  quint32 textSize;
+};
+
+struct PaletteCacheSet
+{
+  quint32 id;
+  quint32 idLength;
+  quint32 name;
+  quint32 nameLength;
+  quint32 firstColor;
+  quint32 colorCount;
+};
+
+struct PaletteCacheColor
+{
+  quint32 id;
+  quint32 name;
+  quint16 idLength;
+  quint16 nameLength;
+  QRgb rgb;
+};
+
+/* appends a string to the text block and returns its offset */
+static quint32 appendText(QVector<ushort> &text, const QString &s)
+{
+  quint32 offset = text.size();
+  const ushort *data = s.utf16();
+  for (int i = 0; i < s.size(); ++i)
+    text.append(data[i]);
+
+  return offset;
+}
+
+PaletteCache::PaletteCache(const QString &path)
+    : path_(path)
+{
+}
+
+PaletteCache::~PaletteCache()
+{
+
+}
+
+bool PaletteCache::load(const QByteArray &digest, MetaColorManager *meta) const
+{
+  QFile file(path_);
+  if (!file.open(QIODevice::ReadOnly))
+    return false;
+
+  QByteArray data = file.readAll();
+  file.close();
+
+  if ((size_t) data.size() < sizeof(PaletteCacheHeader))
+    return false;
+
+  const char *p = data.constData();
+  const PaletteCacheHeader *header =
+      reinterpret_cast<const PaletteCacheHeader *>(p);
+  if (header->magic != PALETTE_CACHE_MAGIC ||
+      header->version != PALETTE_CACHE_VERSION ||
+      digest.size() != PALETTE_CACHE_DIGEST_SIZE ||
+      memcmp(header->digest, digest.constData(), PALETTE_CACHE_DIGEST_SIZE))
+    return false;
+
+  qint64 size = sizeof(PaletteCacheHeader) +
+      (qint64) header->setCount * sizeof(PaletteCacheSet) +
+      (qint64) header->colorCount * sizeof(PaletteCacheColor) +
+      (qint64) header->textSize * sizeof(ushort);
+  if (size != data.size())
+    return false;
+
+  const PaletteCacheSet *sets =
+      reinterpret_cast<const PaletteCacheSet *>(header + 1);
+  const PaletteCacheColor *colors =
+      reinterpret_cast<const PaletteCacheColor *>(sets + header->setCount);
+  const QChar *text =
+      reinterpret_cast<const QChar *>(colors + header->colorCount);
+
+  /* validate all records before touching the manager */
+  for (quint32 i = 0; i < header->setCount; ++i) {
+    const PaletteCacheSet &s = sets[i];
+    if ((qint64) s.id + s.idLength > header->textSize ||
+        (qint64) s.name + s.nameLength > header->textSize ||
+        (qint64) s.firstColor + s.colorCount > header->colorCount)
+      return false;
+  }
+  for (quint32 i = 0; i < header->colorCount; ++i) {
+    const PaletteCacheColor &c = colors[i];
+    if ((qint64) c.id + c.idLength > header->textSize ||
+        (qint64) c.name + c.nameLength > header->textSize)
+      return false;
+  }
+
+  for (quint32 i = 0; i < header->setCount; ++i) {
+    const PaletteCacheSet &s = sets[i];
+    ColorManager *cm = meta->createColorManager(
+        QString(text + s.id, s.idLength),
+        QString(text + s.name, s.nameLength));
+
+    const PaletteCacheColor *c = colors + s.firstColor;
+    for (quint32 j = 0; j < s.colorCount; ++j, ++c) {
+      Color *color = new Color(QString(text + c->name, c->nameLength),
+                               QString(text + c->id, c->idLength),
+                               QColor(c->rgb));
+      color->setParent(cm);
+      cm->add(color);
+    }
+  }
+
+  return true;
+}
+
+bool PaletteCache::save(const QByteArray &digest, MetaColorManager *meta) const
+{
+  if (digest.size() != PALETTE_CACHE_DIGEST_SIZE)
+    return false;
+
+  QVector<PaletteCacheSet> sets;
+  QVector<PaletteCacheColor> colors;
+  QVector<ushort> text;
+
+  foreach (ColorManager *cm, meta->colorManagers()) {
+    PaletteCacheSet s;
+    s.id = appendText(text, cm->id());
+    s.idLength = cm->id().size();
+    s.name = appendText(text, cm->name());
+    s.nameLength = cm->name().size();
+    s.firstColor = colors.size();
+    s.colorCount = cm->count();
+    sets.append(s);
+
+    foreach (const Color *color, cm->colorList()) {
+      /* lengths are stored in 16 bits */
+      if (color->id().size() > 0xffff || color->name().size() > 0xffff)
+        return false;
+
+      PaletteCacheColor c;
+      c.id = appendText(text, color->id());
+      c.idLength = color->id().size();
+      c.name = appendText(text, color->name());
+      c.nameLength = color->name().size();
+      c.rgb = color->color().rgba();
+      colors.append(c);
+    }
+  }
+
+  PaletteCacheHeader header;
+  memset(&header, 0, sizeof(header));
+  header.magic = PALETTE_CACHE_MAGIC;
+  header.version = PALETTE_CACHE_VERSION;
+  memcpy(header.digest, digest.constData(), PALETTE_CACHE_DIGEST_SIZE);
+  header.setCount = sets.size();
+  header.colorCount = colors.size();
+  header.textSize = text.size();
+
+  QByteArray data;
+  data.append(reinterpret_cast<const char *>(&header), sizeof(header));
+  data.append(reinterpret_cast<const char *>(sets.constData()),
+              sets.size() * sizeof(PaletteCacheSet));
+  data.append(reinterpret_cast<const char *>(colors.constData()),
+              colors.size() * sizeof(PaletteCacheColor));
+  data.append(reinterpret_cast<const char *>(text.constData()),
+              text.size() * sizeof(ushort));
+
+  QFileInfo info(path_);
+  if (!QDir().mkpath(info.absolutePath()))
+    return false;
+
+  /* written aside and moved over, so a concurrent start never sees a
+   * partial file */
+  QString temp = path_ + ".tmp";
+  QFile file(temp);
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    return false;
+
+  if (file.write(data) != data.size()) {
+    file.close();
+    file.remove();
+    return false;
+  }
+  file.close();
+
+  if (!Utils::replaceFile(temp, path_)) {
+    QFile::remove(temp);
+    return false;
+  }
+
+  return true;
+}
+
+QString PaletteCache::defaultPath(const QString &source)
+{
+  QString dir = QDesktopServices::storageLocation(
+      QDesktopServices::CacheLocation);
+  if (dir.isEmpty())
+    dir = QDir::tempPath();
+
+  /* one cache per table, named after its location */
+  QByteArray key = QCryptographicHash::hash(
+      QFileInfo(source).absoluteFilePath().toUtf8(),
+      QCryptographicHash::Md5).toHex();
+
+  return QDir(dir).filePath(QString("palette-%1.cache")
+                            .arg(QString::fromLatin1(key)));
+}
+
+QByteArray PaletteCache::digest(const QByteArray &source)
+{
+  return QCryptographicHash::hash(source, QCryptographicHash::Sha1);
+}
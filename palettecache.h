@@ -0,0 +1,38 @@
+#ifndef _PALETTECACHE_H_
+#define _PALETTECACHE_H_
+
+#include <QByteArray>
+#include <QString>
+
+class MetaColorManager;
+
+/* Binary copy of the color tables.
+ *
+ * Parsing the JSON color tables and building a variant tree for every
+ * entry dominates startup, so the parsed tables are written out once in a
+ * flat layout: a header, one record per color set and per color, and a
+ * single block of UTF-16 text the records point into. Loading is one read
+ * followed by a walk over the records. The file is stored in native byte
+ * order in the cache location and carries a digest of the JSON it was
+ * built from; a mismatch of either makes load() fail, and the caller falls
+ * back to the JSON and writes a new cache. */
+class PaletteCache
+{
+ public:
+  PaletteCache(const QString &path);
+  ~PaletteCache();
+
+  const QString& path() const { return path_; }
+
+  bool load(const QByteArray &digest, MetaColorManager *meta) const;
+  bool save(const QByteArray &digest, MetaColorManager *meta) const;
+
+  /* cache file for the color table at the given path */
+  static QString defaultPath(const QString &source);
+  static QByteArray digest(const QByteArray &source);
+
+ private:
+  QString path_;
+};
+
+#endif
@@ -23,6 +23,7 @@ void PaletteModel::setColorManager(ColorManager *cm)
   disconnect(this, SLOT(colorInserted(int)));
   disconnect(this, SLOT(colorDeleted(int)));
   disconnect(this, SLOT(colorSwapped(int, int)));
+  disconnect(this, SLOT(resetModel()));
 
   if (cm) {
     list_ = &cm->colorList();
@@ -35,6 +36,7 @@ void PaletteModel::setColorManager(ColorManager *cm)
             SLOT(colorDeleted(int)));
     connect(cm, SIGNAL(colorSwapped(int, int)), this,
             SLOT(colorSwapped(int, int)));
+    connect(cm, SIGNAL(listReset()), this, SLOT(resetModel()));
     
     reset();
   } else {
@@ -98,7 +100,8 @@ QVariant PaletteModel::data(const QModelIndex &index, int role) const
   if (index.parent().isValid())
     return QVariant();
 
-  if (!list_)
+  /* a tracker's list may change before it announces it */
+  if (!list_ || index.row() >= list_->size())
     return QVariant();
 
   const Color *c = (*list_)[index.row()];
@@ -0,0 +1,233 @@
+#include <cmath>
+
+#include <QHash>
+#include <QList>
+#include <QtConcurrentMap>
+
+#include "color.h"
+#include "colorcache.h"
+#include "imageimporter.h"
+#include "linearsearch.h"
+
+#include "palettereducer.h"
+
+#define REDUCE_MAX_SAMPLES 65536
+#define REDUCE_CHUNK_SIZE 4096
+#define REDUCE_ITERATIONS 8
+
+/* per cluster red, green and blue sums followed by the sample count */
+typedef QVector<qint64> ClusterSums;
+
+struct SampleChunk
+{
+  const QVector<QRgb> *samples;
+  const LinearColorSearch *search;
+  int clusters;
+  int begin;
+  int end;
+};
+
+static ClusterSums assignChunk(const SampleChunk &chunk)
+{
+  ClusterSums sums(chunk.clusters * 4, 0);
+  const QRgb *samples = chunk.samples->constData();
+
+  for (int i = chunk.begin; i < chunk.end; ++i) {
+    QRgb pix = samples[i];
+    int idx = chunk.search->nearestIndex(qRed(pix), qGreen(pix), qBlue(pix));
+    if (idx < 0)
+      continue;
+
+    qint64 *s = sums.data() + idx * 4;
+    s[0] += qRed(pix);
+    s[1] += qGreen(pix);
+    s[2] += qBlue(pix);
+    s[3] += 1;
+  }
+
+  return sums;
+}
+
+static void mergeSums(ClusterSums &result, const ClusterSums &sums)
+{
+  if (result.isEmpty()) {
+    result = sums;
+    return;
+  }
+
+  for (int i = 0; i < result.size(); ++i)
+    result[i] += sums[i];
+}
+
+static int distance(const Color *a, const Color *b)
+{
+  int dr = a->red() - b->red();
+  int dg = a->green() - b->green();
+  int db = a->blue() - b->blue();
+
+  return dr * dr + dg * dg + db * db;
+}
+
+PaletteReducer::PaletteReducer(const ColorLookupCache *cache)
+    : cache_(cache)
+{
+
+}
+
+PaletteReducer::~PaletteReducer()
+{
+
+}
+
+QVector<const Color *> PaletteReducer::reduce(const QImage &image, int count)
+{
+  sample(image);
+
+  QVector<const Color *> centers = seed(count);
+  if (centers.size() < count)
+    return centers;
+
+  for (int i = 0; i < REDUCE_ITERATIONS; ++i) {
+    if (!refine(centers))
+      break;
+  }
+
+  return centers;
+}
+
+void PaletteReducer::sample(const QImage &image)
+{
+  samples_.clear();
+
+  int width = image.width();
+  int height = image.height();
+  int step = (int) ceil(sqrt((double) width * height / REDUCE_MAX_SAMPLES));
+  if (step < 1)
+    step = 1;
+
+  const Color *transparent = cache_->transparent();
+
+  samples_.reserve((width / step + 1) * (height / step + 1));
+  for (int y = 0; y < height; y += step) {
+    const QRgb *line = reinterpret_cast<const QRgb *>(image.constScanLine(y));
+
+    for (int x = 0; x < width; x += step) {
+      QRgb pix = line[x];
+
+      if (qAlpha(pix) < IMPORT_ALPHA_THRESHOLD)
+        continue;
+      if (transparent && cache_->nearest(pix) == transparent)
+        continue;
+
+      samples_.append(pix);
+    }
+  }
+}
+
+QVector<const Color *> PaletteReducer::seed(int count) const
+{
+  QHash<const Color *, int> usage;
+  foreach (QRgb pix, samples_) {
+    const Color *c = cache_->nearest(pix);
+    if (c)
+      ++usage[c];
+  }
+
+  QVector<const Color *> used;
+  QVector<int> weight;
+  for (QHash<const Color *, int>::ConstIterator it = usage.begin();
+       it != usage.end();
+       ++it) {
+    used.append(it.key());
+    weight.append(it.value());
+  }
+
+  if (used.size() <= count)
+    return used;
+
+  /* start from the most used color, then repeatedly take the color
+   * which is frequent and far from everything picked so far */
+  QVector<const Color *> centers;
+  QVector<qint64> mindist(used.size(), -1);
+  QVector<bool> picked(used.size(), false);
+
+  int best = 0;
+  for (int i = 1; i < used.size(); ++i) {
+    if (weight[i] > weight[best])
+      best = i;
+  }
+
+  while (centers.size() < count) {
+    centers.append(used[best]);
+    picked[best] = true;
+
+    qint64 bestScore = -1;
+    for (int i = 0; i < used.size(); ++i) {
+      if (picked[i])
+        continue;
+
+      qint64 d = distance(used[i], used[best]);
+      if (mindist[i] < 0 || d < mindist[i])
+        mindist[i] = d;
+    }
+
+    int next = -1;
+    for (int i = 0; i < used.size(); ++i) {
+      if (picked[i])
+        continue;
+
+      qint64 score = mindist[i] * weight[i];
+      if (score > bestScore) {
+        bestScore = score;
+        next = i;
+      }
+    }
+
+    if (next < 0)
+      break;
+    best = next;
+  }
+
+  return centers;
+}
+
+bool PaletteReducer::refine(QVector<const Color *> &centers) const
+{
+  LinearColorSearch search(centers);
+
+  QList<SampleChunk> chunks;
+  for (int i = 0; i < samples_.size(); i += REDUCE_CHUNK_SIZE) {
+    SampleChunk chunk;
+    chunk.samples = &samples_;
+    chunk.search = &search;
+    chunk.clusters = centers.size();
+    chunk.begin = i;
+    chunk.end = qMin(i + REDUCE_CHUNK_SIZE, samples_.size());
+    chunks.append(chunk);
+  }
+
+  ClusterSums sums = QtConcurrent::blockingMappedReduced(chunks, assignChunk,
+                                                         mergeSums);
+  if (sums.isEmpty())
+    return false;
+
+  bool changed = false;
+  const Color *transparent = cache_->transparent();
+
+  for (int i = 0; i < centers.size(); ++i) {
+    const qint64 *s = sums.constData() + i * 4;
+    if (s[3] == 0)
+      continue;
+
+    const Color *c = cache_->nearest((byte) (s[0] / s[3]),
+                                     (byte) (s[1] / s[3]),
+                                     (byte) (s[2] / s[3]));
+    if (!c || c == transparent || c == centers[i] || centers.contains(c))
+      continue;
+
+    centers[i] = c;
+    changed = true;
+  }
+
+  return changed;
+}
@@ -0,0 +1,37 @@
+#ifndef _PALETTEREDUCER_H_
+#define _PALETTEREDUCER_H_
+
+#include <QColor>
+#include <QImage>
+#include <QVector>
+
+class Color;
+class ColorLookupCache;
+
+/* Picks the colors of a color set which best represent an image.
+ *
+ * This is k-means over a sample of the image pixels with the cluster
+ * centers constrained to the color set: after each assignment pass the
+ * mean of every cluster is snapped back to its nearest color. Seeds are
+ * the most used color followed by colors that are both frequent and far
+ * from the ones already picked. Assignment passes run on the global
+ * thread pool. */
+class PaletteReducer
+{
+ public:
+  PaletteReducer(const ColorLookupCache *cache);
+  ~PaletteReducer();
+
+  QVector<const Color *> reduce(const QImage &image, int count);
+
+ private:
+  void sample(const QImage &image);
+  QVector<const Color *> seed(int count) const;
+  bool refine(QVector<const Color *> &centers) const;
+
+ private:
+  const ColorLookupCache *cache_;
+  QVector<QRgb> samples_;
+};
+
+#endif
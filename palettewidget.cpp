@@ -1,6 +1,7 @@
 #include <QBrush>
 #include <QComboBox>
 #include <QLabel>
+#include <QLineEdit>
 #include <QHBoxLayout>
 #include <QPainter>
 #include <QPaintEvent>
@@ -13,6 +14,7 @@
 
 #include "color.h"
 #include "colormanager.h"
+#include "colorsearch.h"
 #include "document.h"
 #include "globalstate.h"
 #include "settings.h"
@@ -304,7 +306,7 @@ class MyScrollArea : public QScrollArea
 };
 
 PaletteWidget::PaletteWidget(MetaColorManager *meta, QWidget *parent)
-    : QWidget(parent), meta_(meta)
+    : QWidget(parent), meta_(meta), document_(NULL)
 {
   QVBoxLayout *rootLayout = new QVBoxLayout(this);
 
@@ -314,6 +316,12 @@ PaletteWidget::PaletteWidget(MetaColorManager *meta, QWidget *parent)
   colorSetLayout->addWidget(new QLabel(tr("Color Set : ")));
   colorSetLayout->addWidget(colorSet_);
 
+  search_ = new QLineEdit();
+  search_->setToolTip(tr("Search all color sets by number, name, "
+                         "#rrggbb or r, g, b"));
+  searchIndex_ = new ColorSearchIndex(meta_);
+  searchResults_ = new ColorSearchResults(this);
+
   QSplitter *splitter = new QSplitter(Qt::Vertical);
 
   swatchScrollArea_ = new MyScrollArea(splitter);
@@ -328,6 +336,7 @@ PaletteWidget::PaletteWidget(MetaColorManager *meta, QWidget *parent)
   palette_ = new Palette();
 
   rootLayout->addLayout(colorSetLayout);
+  rootLayout->addWidget(search_);
   rootLayout->addWidget(splitter);
   rootLayout->addWidget(palette_);
 
@@ -336,6 +345,8 @@ PaletteWidget::PaletteWidget(MetaColorManager *meta, QWidget *parent)
   connect(swatchWidget_, SIGNAL(indexSelected(int)), listWidget_, SLOT(selectItem(int)));
   connect(swatchWidget_, SIGNAL(indexHovered(int)), this, SLOT(itemHovered(int)));
   connect(colorSet_, SIGNAL(activated(int)), this, SLOT(changeColorSet(int)));
+  connect(search_, SIGNAL(textChanged(const QString &)),
+          this, SLOT(search(const QString &)));
   
   setLayout(rootLayout);
 
@@ -360,7 +371,7 @@ PaletteWidget::PaletteWidget(MetaColorManager *meta, QWidget *parent)
 
 PaletteWidget::~PaletteWidget()
 {
-
+  delete searchIndex_;
 }
 
 void PaletteWidget::setColorManager(ColorManager *cm)
@@ -377,7 +388,8 @@ void PaletteWidget::documentChanged(Document *document)
 {
   document_ = document;
   
-  if (colorSet_->itemData(colorSet_->currentIndex()) == SWATCH_DOCUMENT) {
+  if (search_->text().isEmpty() &&
+      colorSet_->itemData(colorSet_->currentIndex()) == SWATCH_DOCUMENT) {
     if (document)
       setColorManager(document->colorTracker());
     else
@@ -424,6 +436,12 @@ void PaletteWidget::changeColorSet(int index)
   if (index == -1)
     return;
 
+  if (!search_->text().isEmpty()) {
+    search_->blockSignals(true);
+    search_->clear();
+    search_->blockSignals(false);
+  }
+
   QVariant data = colorSet_->itemData(index);
   if (data.type() == QVariant::String) {
     setColorManager(meta_->colorManager(data.toString()));
@@ -439,3 +457,14 @@ void PaletteWidget::changeColorSet(int index)
       setColorManager(NULL);
   }
 }
+
+void PaletteWidget::search(const QString &query)
+{
+  if (query.trimmed().isEmpty()) {
+    changeColorSet(colorSet_->currentIndex());
+    return;
+  }
+
+  searchResults_->setResults(searchIndex_->search(query));
+  setColorManager(searchResults_);
+}
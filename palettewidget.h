@@ -7,12 +7,15 @@
 #include <QWidget>
 
 class QComboBox;
+class QLineEdit;
 class QScrollArea;
 class QMouseEvent;
 class QPaintEvent;
 
 class Color;
 class ColorManager;
+class ColorSearchIndex;
+class ColorSearchResults;
 class Document;
 class MetaColorManager;
 class PaletteModel;
@@ -119,11 +122,15 @@ class PaletteWidget : public QWidget
   void itemHovered(int row);
   void initializeColorSet();
   void changeColorSet(int index);
+  void search(const QString &query);
 
  private:
   const QVector<const Color *> *list_;
 
   QComboBox *colorSet_;
+  QLineEdit *search_;
+  ColorSearchIndex *searchIndex_;
+  ColorSearchResults *searchResults_;
   SwatchWidget *swatchWidget_;
   QScrollArea *swatchScrollArea_;
   PaletteListView *listWidget_;
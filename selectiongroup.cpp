@@ -1,18 +1,178 @@
 #include <QDataStream>
 #include <QGraphicsScene>
+#include <QHash>
+#include <QVector>
 
 #include "cell.h"
 #include "document.h"
 #include "globalstate.h"
 #include "sparsemap.h"
+#include "utils.h"
 
 #include "selectiongroup.h"
 
+#define SELECTION_MAGIC "STSL"
+#define SELECTION_MAGIC_SIZE 4
+#define SELECTION_VERSION 2
+
+#define SELECTION_FLAG_COMPRESSED 0x1
+
+/* bodies up to this size are not worth compressing */
+#define SELECTION_COMPRESS_MIN 4096
+
+/* sanity limits for reading */
+#define SELECTION_MAX_PALETTE (1 << 20)
+
+/* selection in the compact format, colors still as strings */
+struct SelectionData
+{
+  QRect region;
+  QVector<QString> categories;
+  QVector<QString> ids;
+  QVector<QPoint> positions;
+  QVector<quint16> masks;
+
+  /* one table index per feature present, in cell and feature order */
+  QVector<quint32> colors;
+};
+
+static void putString(QByteArray &out, const QString &s)
+{
+  QByteArray utf8 = s.toUtf8();
+  Utils::putVarint(out, utf8.size());
+  out.append(utf8);
+}
+
+static bool getString(const uchar *&p, const uchar *end, QString &s)
+{
+  quint32 length;
+  if (!Utils::getVarint(p, end, length) || (quint32) (end - p) < length)
+    return false;
+
+  s = QString::fromUtf8(reinterpret_cast<const char *>(p), length);
+  p += length;
+
+  return true;
+}
+
+static bool isCompact(const QByteArray &array)
+{
+  return array.startsWith(SELECTION_MAGIC);
+}
+
+static bool readCompact(const QByteArray &array, SelectionData &data)
+{
+  if (array.size() < SELECTION_MAGIC_SIZE + 2 || !isCompact(array) ||
+      (uchar) array[SELECTION_MAGIC_SIZE] != SELECTION_VERSION)
+    return false;
+
+  int flags = (uchar) array[SELECTION_MAGIC_SIZE + 1];
+  QByteArray body = array.mid(SELECTION_MAGIC_SIZE + 2);
+  if (flags & SELECTION_FLAG_COMPRESSED)
+    body = qUncompress(body);
+
+  const uchar *p = reinterpret_cast<const uchar *>(body.constData());
+  const uchar *end = p + body.size();
+
+  quint32 x, y, w, h, count;
+  if (!Utils::getVarint(p, end, x) || !Utils::getVarint(p, end, y) ||
+      !Utils::getVarint(p, end, w) || !Utils::getVarint(p, end, h) ||
+      !Utils::getVarint(p, end, count) || count > SELECTION_MAX_PALETTE)
+    return false;
+  data.region = QRect(x, y, w, h);
+
+  data.categories.resize(count);
+  data.ids.resize(count);
+  for (quint32 i = 0; i < count; ++i) {
+    if (!getString(p, end, data.categories[i]) ||
+        !getString(p, end, data.ids[i]))
+      return false;
+  }
+
+  if (!Utils::getVarint(p, end, count))
+    return false;
+
+  qint64 index = -1;
+  qint64 cells = (qint64) w * h;
+  for (quint32 i = 0; i < count; ++i) {
+    quint32 gap, mask;
+    if (!Utils::getVarint(p, end, gap) || !Utils::getVarint(p, end, mask))
+      return false;
+
+    index += (qint64) gap + 1;
+    if (index >= cells || !mask || mask >> CELL_COUNT)
+      return false;
+
+    for (int f = 0; f < CELL_COUNT; ++f) {
+      if (!(mask & (1 << f)))
+        continue;
+
+      quint32 color;
+      if (!Utils::getVarint(p, end, color) ||
+          color >= (quint32) data.ids.size())
+        return false;
+      data.colors.append(color);
+    }
+
+    data.positions.append(QPoint(index % w, index / w));
+    data.masks.append(mask);
+  }
+
+  return true;
+}
+
 const char* SelectionGroup::mimeType()
+{
+  return "application/vnd.kr.influx.stitchy.selection.v2";
+}
+
+const char* SelectionGroup::legacyMimeType()
 {
   return "application/vnd.kr.influx.stitchy.selection";
 }
 
+bool SelectionGroup::canDecode(const QMimeData *mime)
+{
+  return mime->hasFormat(mimeType()) || mime->hasFormat(legacyMimeType());
+}
+
+QByteArray SelectionGroup::fromMimeData(const QMimeData *mime)
+{
+  if (mime->hasFormat(mimeType()))
+    return mime->data(mimeType());
+
+  return mime->data(legacyMimeType());
+}
+
+QByteArray SelectionGroup::toLegacy(const QByteArray &array)
+{
+  SelectionData data;
+  if (!readCompact(array, data))
+    return QByteArray();
+
+  QByteArray legacy;
+  QDataStream stream(&legacy, QIODevice::WriteOnly);
+
+  const QRect &r = data.region;
+  stream << r.x() << r.y() << r.width() << r.height();
+
+  stream << data.positions.size();
+  int k = 0;
+  for (int i = 0; i < data.positions.size(); ++i) {
+    int mask = data.masks[i];
+    stream << data.positions[i].x() << data.positions[i].y() << mask;
+    for (int f = 0; f < CELL_COUNT; ++f) {
+      if (!(mask & (1 << f)))
+        continue;
+
+      quint32 color = data.colors[k++];
+      stream << f << data.categories[color] << data.ids[color];
+    }
+  }
+
+  return legacy;
+}
+
 SelectionGroup::SelectionGroup(Document *doc)
     : QGraphicsItemGroup()
 {
@@ -62,34 +222,111 @@ void SelectionGroup::moveRel(const QPoint &delta)
 
 QByteArray SelectionGroup::serialize() const
 {
-  QByteArray array;
-  QDataStream stream(&array, QIODevice::WriteOnly);
+  QHash<const Color *, int> index;
+  QByteArray palette;
+  QByteArray cells;
+  int paletteSize = 0;
+  int cellCount = 0;
+  qint64 last = -1;
 
-  stream << region_.x() << region_.y() << region_.width() << region_.height();
-  
   const CellMap &map = map_->cells();
-  stream << map.size();
   for (CellMap::ConstIterator it = map.begin(); it != map.end(); ++it) {
     const Cell *c = it.value();
-    stream << c->pos().x() << c->pos().y();
-    stream << c->featureMask();
-    for (int i = 0; i < CELL_COUNT; ++i) {
-      if (c->contains(i)) {
-        const Color *color = c->color(i);
-        stream << i;
-        if (color->parent())
-          stream << color->parent()->id();
-        else
-          stream << "";
-        stream << color->id();
+    const QPoint &pos = c->pos();
+    int mask = c->featureMask();
+    if (!mask || !QRect(QPoint(0, 0), region_.size()).contains(pos))
+      continue;
+
+    qint64 i = (qint64) pos.y() * region_.width() + pos.x();
+    Utils::putVarint(cells, i - last - 1);
+    Utils::putVarint(cells, mask);
+    for (int f = 0; f < CELL_COUNT; ++f) {
+      if (!(mask & (1 << f)))
+        continue;
+
+      const Color *color = c->color(f);
+      QHash<const Color *, int>::ConstIterator found = index.find(color);
+      if (found == index.end()) {
+        found = index.insert(color, paletteSize++);
+        putString(palette, color && color->parent() ?
+                  color->parent()->id() : QString());
+        putString(palette, color ? color->id() : QString());
       }
+      Utils::putVarint(cells, found.value());
     }
+
+    last = i;
+    ++cellCount;
+  }
+
+  QByteArray body;
+  Utils::putVarint(body, region_.x());
+  Utils::putVarint(body, region_.y());
+  Utils::putVarint(body, region_.width());
+  Utils::putVarint(body, region_.height());
+  Utils::putVarint(body, paletteSize);
+  body.append(palette);
+  Utils::putVarint(body, cellCount);
+  body.append(cells);
+
+  int flags = 0;
+  if (body.size() > SELECTION_COMPRESS_MIN) {
+    body = qCompress(body);
+    flags |= SELECTION_FLAG_COMPRESSED;
   }
 
+  QByteArray array(SELECTION_MAGIC);
+  array.append((char) SELECTION_VERSION);
+  array.append((char) flags);
+  array.append(body);
+
   return array;
 }
 
 void SelectionGroup::deserialize(Document *doc, const QByteArray &array)
+{
+  if (!isCompact(array)) {
+    deserializeLegacy(doc, array);
+    return;
+  }
+
+  map_->clear();
+
+  SelectionData data;
+  if (readCompact(array, data)) {
+    region_ = data.region;
+
+    /* each color in the table is looked up once */
+    const MetaColorManager *meta = GlobalState::self()->colorManager();
+    QVector<const Color *> colors(data.ids.size());
+    for (int i = 0; i < data.ids.size(); ++i)
+      colors[i] = meta->get(data.categories[i], data.ids[i]);
+
+    int k = 0;
+    for (int i = 0; i < data.positions.size(); ++i) {
+      int mask = data.masks[i];
+      Cell *cell = map_->cellAt(data.positions[i]);
+      for (int f = 0; f < CELL_COUNT; ++f) {
+        if (!(mask & (1 << f)))
+          continue;
+
+        const Color *color = colors[data.colors[k++]];
+        if (cell)
+          cell->addFeature(f, color);
+      }
+
+      if (cell)
+        cell->createGraphicsItems(this);
+    }
+  } else {
+    qWarning("Ignoring a corrupted selection");
+  }
+
+  moveTo(position());
+  doc->addItem(this);
+}
+
+void SelectionGroup::deserializeLegacy(Document *doc, const QByteArray &array)
 {
   QDataStream stream(const_cast<QByteArray *>(&array), QIODevice::ReadOnly);
 
@@ -97,6 +334,8 @@ void SelectionGroup::deserialize(Document *doc, const QByteArray &array)
   stream >> x >> y >> w >> h;
   region_ = QRect(x, y, w, h);
 
+  ColorResolver resolver(GlobalState::self()->colorManager());
+
   map_->clear();
   int len;
   stream >> len;
@@ -115,7 +354,7 @@ void SelectionGroup::deserialize(Document *doc, const QByteArray &array)
         stream >> feature;
         stream >> category >> id;
 
-        const Color *color = GlobalState::self()->colorManager()->get(category, id);
+        const Color *color = resolver.resolve(category, id);
         cell->addFeature(j, color);
       }
     }
@@ -153,3 +392,33 @@ void SelectionGroup::initialize(Document *doc, const QRect &region, bool move)
   moveTo(position());
   doc->addItem(this);
 }
+
+/* SelectionMimeData */
+
+SelectionMimeData::SelectionMimeData(const QByteArray &data)
+    : QMimeData()
+{
+  setData(SelectionGroup::mimeType(), data);
+}
+
+SelectionMimeData::~SelectionMimeData()
+{
+
+}
+
+QStringList SelectionMimeData::formats() const
+{
+  QStringList list = QMimeData::formats();
+  list << SelectionGroup::legacyMimeType();
+
+  return list;
+}
+
+QVariant SelectionMimeData::retrieveData(const QString &mimeType,
+                                         QVariant::Type type) const
+{
+  if (mimeType == SelectionGroup::legacyMimeType())
+    return SelectionGroup::toLegacy(data(SelectionGroup::mimeType()));
+
+  return QMimeData::retrieveData(mimeType, type);
+}
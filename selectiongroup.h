@@ -3,16 +3,35 @@
 
 #include <QByteArray>
 #include <QGraphicsItemGroup>
+#include <QMimeData>
 #include <QPoint>
 #include <QRect>
+#include <QStringList>
 
 class Document;
 class SparseMap;
 
+/* Clipboard selections.
+ *
+ * serialize() writes a compact format: a table of the colors used, then
+ * every cell as a varint gap in row-major order within the region, its
+ * feature mask and one varint table index per feature. Larger selections
+ * are zlib compressed on top. Pasting resolves each color in the table
+ * once and builds the cells in one pass. The mime type carries the format
+ * version; the old format, with the color strings repeated for every
+ * feature, is still read and is offered to other instances on request. */
 class SelectionGroup : public QGraphicsItemGroup
 {
  public:
   static const char* mimeType();
+  static const char* legacyMimeType();
+
+  /* whether the clipboard holds a selection in any known format */
+  static bool canDecode(const QMimeData *mime);
+  static QByteArray fromMimeData(const QMimeData *mime);
+
+  /* old format of serialized data, for instances that predate mimeType() */
+  static QByteArray toLegacy(const QByteArray &data);
 
   SelectionGroup(Document *doc);
   SelectionGroup(Document *doc, const QRect &region, bool move = false);
@@ -31,6 +50,7 @@ class SelectionGroup : public QGraphicsItemGroup
 
  private:
   void deserialize(Document *doc, const QByteArray &array);
+  void deserializeLegacy(Document *doc, const QByteArray &array);
   void initialize(Document *doc, const QRect &region, bool move = false);
 
  private:
@@ -38,4 +58,19 @@ class SelectionGroup : public QGraphicsItemGroup
   SparseMap *map_;
 };
 
+/* Selection on the clipboard; the old format is only encoded when a
+ * reader asks for it. */
+class SelectionMimeData : public QMimeData
+{
+ public:
+  SelectionMimeData(const QByteArray &data);
+  ~SelectionMimeData();
+
+  QStringList formats() const;
+
+ protected:
+  QVariant retrieveData(const QString &mimeType,
+                        QVariant::Type type) const;
+};
+
 #endif
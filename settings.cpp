@@ -55,6 +55,11 @@ QByteArray Settings::geometry() const
   return settings_->value("general/geometry", QByteArray()).toByteArray();
 }
 
+bool Settings::journal() const
+{
+  return settings_->value("general/journal", true).toBool();
+}
+
 void Settings::setColorFile(const QString &data)
 {
   settings_->setValue("general/color_file", data);
@@ -70,6 +75,11 @@ void Settings::setGeometry(const QByteArray &data)
   settings_->setValue("general/geometry", data);
 }
 
+void Settings::setJournal(bool enabled)
+{
+  settings_->setValue("general/journal", enabled);
+}
+
 void Settings::writeConfig()
 {
   settings_->sync();
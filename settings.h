@@ -23,10 +23,12 @@ class Settings
   QString colorFile() const;
   QByteArray state() const;
   QByteArray geometry() const;
+  bool journal() const;
 
   void setColorFile(const QString &path);
   void setState(const QByteArray &data);
   void setGeometry(const QByteArray &data);
+  void setJournal(bool enabled);
 
  private:
   void writeConfig();
@@ -3,8 +3,8 @@
 
 #include "sparsemap.h"
 
-SparseMap::SparseMap(Document *parent)
-    : document_(parent)
+SparseMap::SparseMap(Document *parent, ColorUsageTracker *tracker)
+    : document_(parent), tracker_(tracker)
 {
 
 }
@@ -12,6 +12,7 @@ SparseMap::SparseMap(Document *parent)
 SparseMap::SparseMap(const SparseMap &other)
 {
   document_ = other.document_;
+  tracker_ = NULL;
   
   const CellMap &cells = other.cells();
   for (CellMap::ConstIterator it = cells.begin(); it != cells.end(); ++it) {
@@ -38,6 +39,7 @@ Cell* SparseMap::cellAt(const QPoint &pos)
 
   if (it == cells_.end()) {
     Cell *c = new Cell(pos, document_);
+    c->setTracker(tracker_);
     cells_[pos] = c;
     return c;
   }
@@ -57,6 +59,7 @@ Cell* SparseMap::overwrite(const Cell &c)
 
   if (!c.isEmpty()) {
     Cell *newCell = new Cell(c);
+    newCell->setTracker(tracker_);
     cells_.insert(c.pos(), newCell);
 
     return newCell;
@@ -77,6 +80,7 @@ Cell* SparseMap::merge(const Cell &c)
     return oc;
   } else {
     Cell *newCell = new Cell(c);
+    newCell->setTracker(tracker_);
     cells_.insert(c.pos(), newCell);
     
     return newCell;
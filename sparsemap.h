@@ -5,6 +5,7 @@
 #include <QPoint>
 
 class Cell;
+class ColorUsageTracker;
 class Document;
 
 typedef QMap<QPoint, Cell *> CellMap;
@@ -12,7 +13,8 @@ typedef QMap<QPoint, Cell *> CellMap;
 class SparseMap
 {
  public:
-  SparseMap(Document *parent);
+  /* cells of a map with a tracker report their colors to it */
+  SparseMap(Document *parent, ColorUsageTracker *tracker = NULL);
   SparseMap(const SparseMap &other);
   ~SparseMap();
 
@@ -29,6 +31,7 @@ class SparseMap
  private:
   CellMap cells_;
   Document *document_;
+  ColorUsageTracker *tracker_;
 };
 
 bool operator<(const QPoint &a, const QPoint &b);
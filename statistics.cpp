@@ -0,0 +1,42 @@
+#include <cmath>
+
+#include "statistics.h"
+
+#define SQRT2 1.41421356237
+
+/* thread per stitch in cell widths: the front diagonals plus the run
+ * across the back to the next needle hole */
+static const qreal stitchLengths[StitchType_Count] = {
+  2.0 * (SQRT2 + 1.0),
+  SQRT2 + 1.0,
+  (SQRT2 + 1.0) / 2.0,
+  (SQRT2 + 1.0) / 2.0
+};
+
+StitchStatistics::StitchStatistics(int fabricCount, int strands)
+    : fabricCount_(fabricCount), strands_(strands)
+{
+}
+
+qreal StitchStatistics::length(const StitchCounts &counts) const
+{
+  qreal cells = 0.0;
+  for (int i = 0; i < StitchType_Count; ++i)
+    cells += counts.count[i] * stitchLengths[i];
+
+  /* one cell is an inch divided by the fabric count */
+  return cells * 0.0254 / fabricCount_ * THREAD_WASTE_FACTOR;
+}
+
+int StitchStatistics::skeins(qreal length) const
+{
+  if (length <= 0.0)
+    return 0;
+
+  return (int) std::ceil(length * strands_ / (SKEIN_STRANDS * SKEIN_LENGTH));
+}
+
+qreal StitchStatistics::size(int cells) const
+{
+  return cells * 2.54 / fabricCount_;
+}
@@ -0,0 +1,52 @@
+#ifndef _STATISTICS_H_
+#define _STATISTICS_H_
+
+#include "colormanager.h"
+
+/* fabric counts offered, in stitches per inch */
+#define STATISTICS_MIN_FABRIC_COUNT 6
+#define STATISTICS_MAX_FABRIC_COUNT 40
+#define STATISTICS_DEFAULT_FABRIC_COUNT 14
+#define STATISTICS_DEFAULT_STRANDS 2
+
+/* strands in a skein and the length of one, in meters */
+#define SKEIN_STRANDS 6
+#define SKEIN_LENGTH 8.0
+
+/* extra thread for starting, ending and travelling between stitches */
+#define THREAD_WASTE_FACTOR 1.15
+
+/* Thread consumption estimates.
+ *
+ * Lengths are derived from the stitch counts a ColorUsageTracker keeps,
+ * counting the diagonals on the front of the fabric and the straight
+ * runs on the back, so the figures for a color cost constant time no
+ * matter how large the chart is. */
+class StitchStatistics
+{
+ public:
+  StitchStatistics(int fabricCount = STATISTICS_DEFAULT_FABRIC_COUNT,
+                   int strands = STATISTICS_DEFAULT_STRANDS);
+
+  int fabricCount() const { return fabricCount_; }
+  void setFabricCount(int count) { fabricCount_ = count; }
+
+  /* strands stitched with at once */
+  int strands() const { return strands_; }
+  void setStrands(int strands) { strands_ = strands; }
+
+  /* thread needed for the stitches, in meters */
+  qreal length(const StitchCounts &counts) const;
+
+  /* skeins needed for the given length of thread */
+  int skeins(qreal length) const;
+
+  /* finished size of the given number of cells, in centimeters */
+  qreal size(int cells) const;
+
+ private:
+  int fabricCount_;
+  int strands_;
+};
+
+#endif
@@ -0,0 +1,198 @@
+#include <QFormLayout>
+#include <QLabel>
+#include <QSpinBox>
+#include <QTreeWidget>
+#include <QVBoxLayout>
+
+#include "color.h"
+#include "document.h"
+
+#include "statisticswidget.h"
+
+#define COLUMN_ID 0
+#define COLUMN_NAME 1
+#define COLUMN_FULL 2
+#define COLUMN_LENGTH (COLUMN_FULL + StitchType_Count)
+#define COLUMN_SKEINS (COLUMN_LENGTH + 1)
+#define COLUMN_COUNT (COLUMN_SKEINS + 1)
+
+/* sorts numeric columns by value rather than by text */
+class StatisticsItem : public QTreeWidgetItem
+{
+ public:
+  bool operator<(const QTreeWidgetItem &other) const
+  {
+    int column = treeWidget()->sortColumn();
+    if (column < COLUMN_FULL)
+      return QTreeWidgetItem::operator<(other);
+
+    return data(column, Qt::UserRole).toDouble() <
+        other.data(column, Qt::UserRole).toDouble();
+  }
+};
+
+StatisticsWidget::StatisticsWidget(QWidget *parent)
+    : QWidget(parent)
+{
+  document_ = NULL;
+  tracker_ = NULL;
+  skeins_ = 0;
+
+  fabricCount_ = new QSpinBox;
+  fabricCount_->setRange(STATISTICS_MIN_FABRIC_COUNT,
+                         STATISTICS_MAX_FABRIC_COUNT);
+  fabricCount_->setValue(statistics_.fabricCount());
+  fabricCount_->setSuffix(tr(" count"));
+
+  strands_ = new QSpinBox;
+  strands_->setRange(1, SKEIN_STRANDS);
+  strands_->setValue(statistics_.strands());
+
+  QFormLayout *form = new QFormLayout;
+  form->addRow(tr("Fabric:"), fabricCount_);
+  form->addRow(tr("Strands:"), strands_);
+
+  QStringList headers;
+  headers << tr("No.") << tr("Name") << tr("Full") << tr("Half")
+          << tr("Petite") << tr("Quarter") << tr("Length (m)")
+          << tr("Skeins");
+
+  tree_ = new QTreeWidget;
+  tree_->setColumnCount(COLUMN_COUNT);
+  tree_->setHeaderLabels(headers);
+  tree_->setRootIsDecorated(false);
+  tree_->setSortingEnabled(true);
+  tree_->sortByColumn(COLUMN_ID, Qt::AscendingOrder);
+
+  totals_ = new QLabel;
+  totals_->setWordWrap(true);
+
+  QVBoxLayout *layout = new QVBoxLayout;
+  layout->addLayout(form);
+  layout->addWidget(tree_);
+  layout->addWidget(totals_);
+  setLayout(layout);
+
+  connect(fabricCount_, SIGNAL(valueChanged(int)),
+          this, SLOT(settingsChanged()));
+  connect(strands_, SIGNAL(valueChanged(int)),
+          this, SLOT(settingsChanged()));
+
+  updateTotals();
+}
+
+StatisticsWidget::~StatisticsWidget()
+{
+
+}
+
+void StatisticsWidget::documentChanged(Document *document)
+{
+  if (tracker_)
+    disconnect(tracker_, NULL, this, NULL);
+
+  document_ = document;
+  tracker_ = document ? document->colorTracker() : NULL;
+
+  if (tracker_)
+    connect(tracker_, SIGNAL(usageChanged()), this, SLOT(usageChanged()));
+
+  rebuild();
+}
+
+void StatisticsWidget::usageChanged()
+{
+  tree_->setSortingEnabled(false);
+  foreach (const Color *color, tracker_->changedColors())
+    updateColor(color);
+  tree_->setSortingEnabled(true);
+
+  updateTotals();
+}
+
+void StatisticsWidget::settingsChanged()
+{
+  statistics_.setFabricCount(fabricCount_->value());
+  statistics_.setStrands(strands_->value());
+
+  rebuild();
+}
+
+void StatisticsWidget::rebuild()
+{
+  tree_->clear();
+  items_.clear();
+  skeins_ = 0;
+
+  if (tracker_) {
+    tree_->setSortingEnabled(false);
+    foreach (const Color *color, tracker_->colorList())
+      updateColor(color);
+    tree_->setSortingEnabled(true);
+  }
+
+  updateTotals();
+}
+
+void StatisticsWidget::updateColor(const Color *color)
+{
+  StitchCounts counts = tracker_->counts(color);
+  QTreeWidgetItem *item = items_.value(color);
+
+  if (item)
+    skeins_ -= item->data(COLUMN_SKEINS, Qt::UserRole).toInt();
+
+  if (counts.total() == 0) {
+    if (item) {
+      items_.remove(color);
+      delete item;
+    }
+    return;
+  }
+
+  if (!item) {
+    item = new StatisticsItem;
+    item->setText(COLUMN_ID, color->id());
+    item->setText(COLUMN_NAME, color->name());
+    item->setData(COLUMN_ID, Qt::DecorationRole, color->color());
+    for (int i = COLUMN_FULL; i < COLUMN_COUNT; ++i)
+      item->setTextAlignment(i, Qt::AlignRight | Qt::AlignVCenter);
+
+    tree_->addTopLevelItem(item);
+    items_.insert(color, item);
+  }
+
+  for (int i = 0; i < StitchType_Count; ++i) {
+    item->setText(COLUMN_FULL + i, QString::number(counts.count[i]));
+    item->setData(COLUMN_FULL + i, Qt::UserRole, counts.count[i]);
+  }
+
+  qreal length = statistics_.length(counts);
+  int skeins = statistics_.skeins(length);
+  item->setText(COLUMN_LENGTH, QString::number(length, 'f', 1));
+  item->setData(COLUMN_LENGTH, Qt::UserRole, length);
+  item->setText(COLUMN_SKEINS, QString::number(skeins));
+  item->setData(COLUMN_SKEINS, Qt::UserRole, skeins);
+  skeins_ += skeins;
+}
+
+void StatisticsWidget::updateTotals()
+{
+  if (!tracker_) {
+    totals_->clear();
+    return;
+  }
+
+  const StitchCounts &counts = tracker_->totalCounts();
+
+  QSize size = document_->size();
+  totals_->setText(
+      tr("%1 colors, %2 stitches, %3 m of thread, %4 skeins. "
+         "Finished size %5 x %6 cm.")
+      .arg(items_.size())
+      .arg(counts.total())
+      .arg(statistics_.length(counts), 0, 'f', 1)
+      .arg(skeins_)
+      .arg(statistics_.size(size.width()), 0, 'f', 1)
+      .arg(statistics_.size(size.height()), 0, 'f', 1));
+}
@@ -0,0 +1,57 @@
+#ifndef _STATISTICSWIDGET_H_
+#define _STATISTICSWIDGET_H_
+
+#include <QHash>
+#include <QWidget>
+
+#include "statistics.h"
+
+class QLabel;
+class QSpinBox;
+class QTreeWidget;
+class QTreeWidgetItem;
+
+class Color;
+class Document;
+
+/* Per-color stitch counts and thread estimates of the active document.
+ *
+ * Rows are refreshed from the tracker's changed colors only, so an edit
+ * costs time in proportion to the colors it touched; the whole table is
+ * rebuilt only when the document or the fabric settings change. */
+class StatisticsWidget : public QWidget
+{
+  Q_OBJECT;
+
+ public:
+  StatisticsWidget(QWidget *parent = NULL);
+  ~StatisticsWidget();
+
+ public slots:
+  void documentChanged(Document *document);
+
+ private slots:
+  void usageChanged();
+  void settingsChanged();
+
+ private:
+  void rebuild();
+  void updateColor(const Color *color);
+  void updateTotals();
+
+ private:
+  StitchStatistics statistics_;
+  Document *document_;
+  ColorUsageTracker *tracker_;
+  QHash<const Color *, QTreeWidgetItem *> items_;
+
+  /* skeins are bought per color, so this is the sum over the rows */
+  int skeins_;
+
+  QSpinBox *fabricCount_;
+  QSpinBox *strands_;
+  QTreeWidget *tree_;
+  QLabel *totals_;
+};
+
+#endif
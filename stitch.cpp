@@ -59,18 +59,6 @@ StitchItem::~StitchItem()
 
 }
 
-void StitchItem::acquire()
-{
-  if (document_)
-    document_->acquire(this);
-}
-
-void StitchItem::release()
-{
-  if (document_)
-    document_->release(this);
-}
-
 /*
  * PositionedStitchItem
  */
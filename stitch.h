@@ -18,6 +18,15 @@ enum Orientation {
   Orientation_Backslash
 };
 
+enum StitchType
+{
+  StitchType_Full,
+  StitchType_Half,
+  StitchType_Petite,
+  StitchType_Quarter,
+  StitchType_Count
+};
+
 class StitchItem : public QGraphicsItem
 {
  public:
@@ -26,9 +35,6 @@ class StitchItem : public QGraphicsItem
              QGraphicsItem *parent = NULL);
   virtual ~StitchItem();
 
-  void acquire();
-  void release();
-
   const Color* color() const { return color_; }
 
   void setColor(Color *c) { color_ = c; }
@@ -21,53 +21,87 @@ FORMS += \
   newdocumentdialog.ui
 
 HEADERS += \
+  autosaver.h \
+  batchconverter.h \
   canvas.h \
   cell.h \
   color.h \
+  colorcache.h \
   coloreditor.h \
   colormanager.h \
+  colorsearch.h \
   common.h \
+  confetticleaner.h \
   document.h \
   documentio.h \
   documentpropertiesdialog.h \
   editor.h \
   editoractions.h \
+  floodfill.h \
+  flossconverter.h \
   globalstate.h \
+  imageimporter.h \
+  imagescaler.h \
   importdialog.h \
+  journal.h \
+  jsonstream.h \
   kdtree.h \
+  linearsearch.h \
   mainwindow.h \
   newdocumentdialog.h \
+  palettecache.h \
   palettemodel.h \
+  palettereducer.h \
   palettewidget.h \
   selection.h \
   selectiongroup.h \
   settings.h \
   sparsemap.h \
+  statistics.h \
+  statisticswidget.h \
   stitch.h \
+  tileloader.h \
   utils.h
 
 SOURCES += \
+  autosaver.cpp \
+  batchconverter.cpp \
   canvas.cpp \
   cell.cpp \
   color.cpp \
+  colorcache.cpp \
   coloreditor.cpp \
   colormanager.cpp \
+  colorsearch.cpp \
+  confetticleaner.cpp \
   document.cpp \
   documentio.cpp \
   documentpropertiesdialog.cpp \
   editor.cpp \
   editoractions.cpp \
+  floodfill.cpp \
+  flossconverter.cpp \
   globalstate.cpp \
+  imageimporter.cpp \
+  imagescaler.cpp \
   importdialog.cpp \
+  journal.cpp \
+  jsonstream.cpp \
   kdtree.cpp \
+  linearsearch.cpp \
   mainwindow.cpp \
   newdocumentdialog.cpp \
+  palettecache.cpp \
   palettemodel.cpp \
+  palettereducer.cpp \
   palettewidget.cpp \
   selection.cpp \
   selectiongroup.cpp \
   settings.cpp \
   sparsemap.cpp \
+  statistics.cpp \
+  statisticswidget.cpp \
   stitch.cpp \
+  tileloader.cpp \
   utils.cpp \
   main.cpp
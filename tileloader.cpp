@@ -0,0 +1,286 @@
+#include <QMutexLocker>
+#include <QThreadPool>
+#include <QTime>
+#include <QtConcurrentRun>
+
+#include "cell.h"
+#include "document.h"
+#include "sparsemap.h"
+#include "utils.h"
+
+#include "tileloader.h"
+
+/* time spent merging tiles per event loop pass, in milliseconds */
+#define TILE_MERGE_BUDGET 20
+
+TileLoader::TileLoader(Document *document,
+                       const QVector<const Color *> &palette,
+                       const QVector<TileRecord> &tiles,
+                       const QByteArray &data, int tileSize, bool compressed)
+    : QObject(document), document_(document), palette_(palette),
+      tiles_(tiles), data_(data), tileSize_(tileSize),
+      compressed_(compressed), bounds_(document->boundingRect()),
+      canceled_(false), mergePosted_(false),
+      merged_(0)
+{
+  states_.fill(TileState_Pending, tiles_.size());
+}
+
+TileLoader::~TileLoader()
+{
+  mutex_.lock();
+  canceled_ = true;
+  mutex_.unlock();
+
+  foreach (QFuture<void> worker, workers_)
+    worker.waitForFinished();
+  qDeleteAll(ready_);
+}
+
+void TileLoader::start()
+{
+  if (tiles_.isEmpty()) {
+    emit finished();
+    return;
+  }
+
+  int threads = QThreadPool::globalInstance()->maxThreadCount();
+  int count = qBound(1, threads, tiles_.size());
+  for (int i = 0; i < count; ++i)
+    workers_.append(QtConcurrent::run(this, &TileLoader::run));
+}
+
+void TileLoader::ensureLoaded(const QRect &region)
+{
+  for (int i = 0; i < tiles_.size(); ++i) {
+    if (!region.isNull() && !region.intersects(tileRect(i)))
+      continue;
+
+    DecodedTile *tile = NULL;
+    {
+      QMutexLocker locker(&mutex_);
+
+      while (states_[i] == TileState_Decoding)
+        decoded_.wait(&mutex_);
+
+      if (states_[i] == TileState_Merged)
+        continue;
+
+      if (states_[i] == TileState_Decoded) {
+        tile = ready_.take(i);
+      } else {
+        /* decode here rather than wait for the worker to get to it */
+        states_[i] = TileState_Decoding;
+        locker.unlock();
+        tile = decode(i);
+        locker.relock();
+      }
+
+      states_[i] = TileState_Merged;
+      decoded_.wakeAll();
+    }
+
+    merge(tile);
+  }
+}
+
+void TileLoader::setVisibleRegion(const QRect &region)
+{
+  QMutexLocker locker(&mutex_);
+  visible_ = region;
+}
+
+void TileLoader::mergeReady()
+{
+  QTime timer;
+  timer.start();
+
+  for (;;) {
+    DecodedTile *tile;
+    {
+      QMutexLocker locker(&mutex_);
+
+      if (ready_.isEmpty() || timer.elapsed() > TILE_MERGE_BUDGET) {
+        /* leave the rest to the next pass so the view stays live */
+        mergePosted_ = !ready_.isEmpty();
+        if (mergePosted_)
+          QMetaObject::invokeMethod(this, "mergeReady", Qt::QueuedConnection);
+        return;
+      }
+
+      QHash<int, DecodedTile *>::Iterator it = ready_.begin();
+      states_[it.key()] = TileState_Merged;
+      tile = it.value();
+      ready_.erase(it);
+    }
+
+    merge(tile);
+  }
+}
+
+void TileLoader::run()
+{
+  for (;;) {
+    int index;
+    {
+      QMutexLocker locker(&mutex_);
+      if (canceled_)
+        return;
+
+      index = takeNext();
+      if (index < 0)
+        return;
+    }
+
+    DecodedTile *tile = decode(index);
+
+    QMutexLocker locker(&mutex_);
+    states_[index] = TileState_Decoded;
+    ready_.insert(index, tile);
+    decoded_.wakeAll();
+    postMerge();
+  }
+}
+
+int TileLoader::takeNext()
+{
+  /* visible tiles first, then in file order */
+  int next = -1;
+  for (int i = 0; i < tiles_.size(); ++i) {
+    if (states_[i] != TileState_Pending)
+      continue;
+
+    if (visible_.intersects(tileRect(i))) {
+      next = i;
+      break;
+    }
+    if (next < 0)
+      next = i;
+  }
+
+  if (next >= 0)
+    states_[next] = TileState_Decoding;
+
+  return next;
+}
+
+QRect TileLoader::tileRect(int index) const
+{
+  const TileRecord &r = tiles_[index];
+  return QRect(r.x * tileSize_, r.y * tileSize_, tileSize_, tileSize_);
+}
+
+DecodedTile* TileLoader::decode(int index) const
+{
+  DecodedTile *tile = new DecodedTile;
+  if (!decode(data_, tiles_[index], tileSize_, compressed_, palette_,
+              bounds_, *tile))
+    qWarning("Skipping corrupted tile %d of the document", index);
+
+  return tile;
+}
+
+void TileLoader::merge(DecodedTile *tile)
+{
+  /* cells coming in from the file are not edits */
+  ColorUsageTracker *tracker = document_->colorTracker();
+  bool recording = tracker->isRecording();
+  tracker->setRecording(false);
+  insert(document_->map(), *tile);
+  tracker->setRecording(recording);
+
+  delete tile;
+
+  if (++merged_ == tiles_.size()) {
+    data_.clear();
+    emit finished();
+  }
+}
+
+void TileLoader::postMerge()
+{
+  if (mergePosted_)
+    return;
+
+  mergePosted_ = true;
+  QMetaObject::invokeMethod(this, "mergeReady", Qt::QueuedConnection);
+}
+
+void TileLoader::insert(SparseMap *map, const DecodedTile &tile)
+{
+  int k = 0;
+  for (int i = 0; i < tile.positions.size(); ++i) {
+    Cell *c = map->cellAt(tile.positions[i]);
+    int mask = tile.masks[i];
+
+    /* cells outside the document are dropped */
+    if (!c) {
+      for (int f = 0; f < CELL_COUNT; ++f)
+        k += (mask >> f) & 1;
+      continue;
+    }
+
+    for (int f = 0; f < CELL_COUNT; ++f) {
+      if (mask & (1 << f))
+        c->addFeature(f, tile.colors[k++]);
+    }
+    c->createGraphicsItems();
+  }
+}
+
+bool TileLoader::decode(const QByteArray &data, const TileRecord &record,
+                        int tileSize, bool compressed,
+                        const QVector<const Color *> &palette,
+                        const QRect &bounds, DecodedTile &tile)
+{
+  QByteArray payload = QByteArray::fromRawData(data.constData() + record.offset,
+                                               record.size);
+  QByteArray raw = compressed ? qUncompress(payload) : payload;
+  if ((quint32) raw.size() != record.rawSize)
+    return false;
+
+  const uchar *p = reinterpret_cast<const uchar *>(raw.constData());
+  const uchar *end = p + raw.size();
+  qint64 index = -1;
+  qint64 cells = (qint64) tileSize * tileSize;
+
+  tile.positions.reserve(record.cellCount);
+  tile.masks.reserve(record.cellCount);
+
+  for (quint32 i = 0; i < record.cellCount; ++i) {
+    quint32 gap, mask;
+    if (!Utils::getVarint(p, end, gap) || !Utils::getVarint(p, end, mask))
+      return false;
+
+    index += (qint64) gap + 1;
+    if (index >= cells || !mask || mask >> CELL_COUNT)
+      return false;
+
+    /* the cell only goes in once all its colors are known good */
+    int first = tile.colors.size();
+    for (int f = 0; f < CELL_COUNT; ++f) {
+      if (!(mask & (1 << f)))
+        continue;
+
+      quint32 color;
+      if (!Utils::getVarint(p, end, color) ||
+          color >= (quint32) palette.size()) {
+        tile.colors.resize(first);
+        return false;
+      }
+      tile.colors.append(palette[color]);
+    }
+
+    QPoint pos(record.x * tileSize + (int) (index % tileSize),
+               record.y * tileSize + (int) (index / tileSize));
+    if (!bounds.contains(pos)) {
+      tile.colors.resize(first);
+      return false;
+    }
+
+    tile.positions.append(pos);
+    tile.masks.append(mask);
+  }
+
+  return true;
+}
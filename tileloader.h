@@ -0,0 +1,128 @@
+#ifndef _TILELOADER_H_
+#define _TILELOADER_H_
+
+#include <QByteArray>
+#include <QFuture>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QObject>
+#include <QPoint>
+#include <QRect>
+#include <QVector>
+#include <QWaitCondition>
+
+class Color;
+class Document;
+class SparseMap;
+
+/* a tile of a document file, as listed in its tile index */
+struct TileRecord
+{
+  qint32 x;
+  qint32 y;
+  quint32 cellCount;
+  quint32 rawSize;
+  quint32 offset;
+  quint32 size;
+};
+
+/* cells of a tile, decoded but not yet in the document */
+struct DecodedTile
+{
+  QVector<QPoint> positions;
+  QVector<quint16> masks;
+
+  /* one per feature present, in cell and feature order */
+  QVector<const Color *> colors;
+};
+
+/* Background loading of document tiles.
+ *
+ * The loader keeps the tile payloads of a document file and decodes them
+ * on as many workers as there are cores, tiles in the visible region
+ * first. Tiles are independent, so workers only share the queue. Decoded tiles
+ * are merged into the document on the GUI thread in small batches, since
+ * cells and graphics items may only be created there. Code that is about
+ * to read or edit a part of the document calls ensureLoaded(), which
+ * decodes and merges the tiles of that part right away; everything else
+ * may work on the loaded part while the rest streams in. */
+class TileLoader : public QObject
+{
+  Q_OBJECT;
+
+ public:
+  TileLoader(Document *document, const QVector<const Color *> &palette,
+             const QVector<TileRecord> &tiles, const QByteArray &data,
+             int tileSize, bool compressed);
+  ~TileLoader();
+
+  void start();
+
+  bool isLoaded() const { return merged_ == tiles_.size(); }
+
+  /* merges every tile intersecting the region, all tiles for a null
+   * region */
+  void ensureLoaded(const QRect &region);
+
+  /* region shown, in cells; its tiles are decoded first */
+  void setVisibleRegion(const QRect &region);
+
+  /* creates the cells of a decoded tile in the map, in one pass */
+  static void insert(SparseMap *map, const DecodedTile &tile);
+
+  /* decodes a tile payload, false if it is corrupted or has cells
+   * outside bounds */
+  static bool decode(const QByteArray &data, const TileRecord &record,
+                     int tileSize, bool compressed,
+                     const QVector<const Color *> &palette,
+                     const QRect &bounds, DecodedTile &tile);
+
+ signals:
+  void finished();
+
+ private slots:
+  void mergeReady();
+
+ private:
+  enum TileState
+  {
+    TileState_Pending,
+    TileState_Decoding,
+    TileState_Decoded,
+    TileState_Merged
+  };
+
+  void run();
+  int takeNext();
+  QRect tileRect(int index) const;
+  DecodedTile* decode(int index) const;
+  void merge(DecodedTile *tile);
+  void postMerge();
+
+ private:
+  Document *document_;
+  QVector<const Color *> palette_;
+  QVector<TileRecord> tiles_;
+  QByteArray data_;
+  int tileSize_;
+  bool compressed_;
+
+  /* document rect when loading started, read by the workers */
+  QRect bounds_;
+
+  /* guards everything below */
+  QMutex mutex_;
+  QWaitCondition decoded_;
+  QVector<TileState> states_;
+  QHash<int, DecodedTile *> ready_;
+  QRect visible_;
+  bool canceled_;
+  bool mergePosted_;
+
+  /* GUI thread only */
+  int merged_;
+  QList<QFuture<void> > workers_;
+};
+
+#endif
@@ -1,3 +1,12 @@
+#include <QDir>
+#include <QFile>
+
+#ifdef Q_OS_WIN
+#include <windows.h>
+#else
+#include <cstdio>
+#endif
+
 #include "utils.h"
 
 QPointF Utils::mapToCoord(const QPoint &point)
@@ -9,3 +18,39 @@ QIcon Utils::icon(const QString &name)
 {
   return QIcon::fromTheme(name, QIcon(":/icons/fallback/" + name + ".png"));
 }
+
+void Utils::putVarint(QByteArray &out, quint32 value)
+{
+  while (value >= 0x80) {
+    out.append((char) (value | 0x80));
+    value >>= 7;
+  }
+  out.append((char) value);
+}
+
+bool Utils::getVarint(const uchar *&p, const uchar *end, quint32 &value)
+{
+  value = 0;
+  for (int shift = 0; shift < 35 && p < end; shift += 7) {
+    uchar b = *p++;
+    value |= (quint32) (b & 0x7f) << shift;
+    if (!(b & 0x80))
+      return true;
+  }
+
+  return false;
+}
+
+bool Utils::replaceFile(const QString &from, const QString &to)
+{
+#ifdef Q_OS_WIN
+  QString src = QDir::toNativeSeparators(from);
+  QString dst = QDir::toNativeSeparators(to);
+  return MoveFileExW(reinterpret_cast<const wchar_t *>(src.utf16()),
+                     reinterpret_cast<const wchar_t *>(dst.utf16()),
+                     MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+#else
+  return ::rename(QFile::encodeName(from).constData(),
+                  QFile::encodeName(to).constData()) == 0;
+#endif
+}
@@ -1,15 +1,25 @@
 #ifndef _UTILS_H_
 #define _UTILS_H_
 
+#include <QByteArray>
 #include <QIcon>
 #include <QPoint>
 #include <QPointF>
+#include <QString>
 
 class Utils
 {
  public:
   static QPointF mapToCoord(const QPoint &point);
   static QIcon icon(const QString &name);
+
+  /* LEB128 style unsigned integers, 7 bits per byte */
+  static void putVarint(QByteArray &out, quint32 value);
+  static bool getVarint(const uchar *&p, const uchar *end, quint32 &value);
+
+  /* moves from over to, replacing to in one step so that either the old
+   * or the new file is there at any time */
+  static bool replaceFile(const QString &from, const QString &to);
 };
 
 #endif